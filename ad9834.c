@@ -3,7 +3,9 @@
 
 #include "ad9834.h"
 #include <stdint.h>
+#include <math.h>
 #include "hardware/spi.h"
+#include "hardware/dma.h"
 #include "pico/stdlib.h"
 #include "pico/binary_info.h"
 #include <hardware/clocks.h>
@@ -20,14 +22,29 @@ const static double _freq_factor = (double) (1<<28) / (double) _ad9834_clock_fre
 
 static bool _freq_reg = 0;  // Keeps track of current freq reg, to alternate for a smooth transition
 
+// Frequency writes are queued to the SPI by DMA, from a buffer that must stay put until it is sent
+static uint _dma_ch;
+static uint16_t _burst[3];
+
 /* Sends data to the AD9834 and handles the fsync pin appropriately as per datasheet timing
 */
 static inline void _transfer16(uint16_t data_to_send) {
+    ad9834_wait_idle();
     // gpio_put(AD9834_FSY, 0);   // FSY is treated as CS by SPI h/w
     spi_write16_blocking(spi_default, &data_to_send, 1);
     // gpio_put(AD9834_FSY, 1);
 }
 
+/* Queues words to the AD9834 as one DMA transfer and returns without waiting for them.
+   The SPI frames each 16-bit word with FSY, so they are the same as separate transfers.
+*/
+static void _transfer_burst(const uint16_t *words, uint count) {
+    ad9834_wait_idle();
+    for(uint i = 0; i < count; i++) _burst[i] = words[i];
+    dma_channel_set_read_addr(_dma_ch, _burst, false);
+    dma_channel_set_trans_count(_dma_ch, count, true);
+}
+
 // Initialize the chip
 void ad9834_init() {
     // Initialize Reference clock
@@ -49,9 +66,23 @@ void ad9834_init() {
     gpio_set_dir(AD9834_FSY, true);
 
     // Init spi functionality
-    spi_init(spi_default, 9600);
+    spi_init(spi_default, AD9834_SPI_BAUD);
     spi_set_format(spi_default, 16, SPI_CPOL_1, SPI_CPHA_0, SPI_MSB_FIRST);
 
+    // DMA channel to feed frequency writes to the SPI, paced by its TX FIFO
+    _dma_ch = dma_claim_unused_channel(true);
+    dma_channel_config cfg = dma_channel_get_default_config(_dma_ch);
+    channel_config_set_transfer_data_size(&cfg, DMA_SIZE_16);
+    channel_config_set_read_increment(&cfg, true);
+    channel_config_set_write_increment(&cfg, false);
+    channel_config_set_dreq(&cfg, spi_get_dreq(spi_default, true));
+    dma_channel_configure(_dma_ch, &cfg,
+        &spi_get_hw(spi_default)->dr,   // dst
+        _burst,                         // src
+        0,                              // transfer count, set per burst
+        false                           // don't start yet
+    );
+
     // Init device
     _freq_reg = 0;  // Start with FREQ0 always for consistency
     gpio_put(AD9834_FSY, 1);    // FSYNC to 1  (initially)
@@ -64,19 +95,58 @@ void ad9834_init() {
 
 // Change the frequency as per the method in the datasheet
 void ad9834_setfreq(unsigned long int freq) {
+    ad9834_setfreq_word((uint32_t) (_freq_factor * freq));
+}
+
+// Tuning word nearest to a frequency in Hz
+uint32_t ad9834_freq_word(double freq) {
+    return (uint32_t) lround(_freq_factor * freq) & AD9834_FREQ_WORD_MASK;
+}
+
+// Frequency in Hz that a tuning word gives
+double ad9834_word_freq(uint32_t freq_reg_val) {
+    return freq_reg_val / _freq_factor;
+}
 
+// Loads a tuning word into the idle frequency register and switches to it
+void ad9834_setfreq_word(uint32_t freq_reg_val) {
     // Calculate values for the frequecy registers
-    unsigned long int freq_reg_val = (unsigned long int) (_freq_factor * freq);
-    uint16_t MSW = (freq_reg_val & 0xFFFC000) >> 14;
-    uint16_t LSW = (freq_reg_val & 0x3FFF);
+    ad9834_setfreq_halves(AD9834_FREQ_LSW(freq_reg_val), AD9834_FREQ_MSW(freq_reg_val));
+}
 
+// Loads a split tuning word into the idle frequency register and switches to it
+void ad9834_setfreq_halves(uint16_t LSW, uint16_t MSW) {
     // Figure out address to use for frequecy register
     uint16_t freq_reg_addr = _freq_reg ? 0x8000 : 0x4000;
 
-    _transfer16(LSW | freq_reg_addr);  // Freq reg load
-    _transfer16(MSW | freq_reg_addr);
+    uint16_t words[] = {
+        LSW | freq_reg_addr,  // Freq reg load
+        MSW | freq_reg_addr,
+        _init_code | (_freq_reg * 0x800)  // Switch reg
+    };
+    _transfer_burst(words, 3);
+
+    _freq_reg = !_freq_reg;
+}
+
+// Loads a split tuning word into the idle frequency register, leaving the output as it is
+void ad9834_preload_halves(uint16_t LSW, uint16_t MSW) {
+    uint16_t freq_reg_addr = _freq_reg ? 0x8000 : 0x4000;
+
+    uint16_t words[] = {LSW | freq_reg_addr, MSW | freq_reg_addr};
+    _transfer_burst(words, 2);
+}
 
-    _transfer16(_init_code | (_freq_reg * 0x800));  // Switch reg
+// Switches the output to the frequency from ad9834_preload_halves
+void ad9834_select_preloaded() {
+    uint16_t words[] = {_init_code | (_freq_reg * 0x800)};
+    _transfer_burst(words, 1);
 
     _freq_reg = !_freq_reg;
 }
+
+// Waits until queued writes have reached the AD9834
+void ad9834_wait_idle() {
+    dma_channel_wait_for_finish_blocking(_dma_ch);
+    while(spi_is_busy(spi_default)) tight_loop_contents();
+}
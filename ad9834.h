@@ -10,13 +10,40 @@
 #define AD9834_TXD 3    // Serial Data 
 #define AD9834_FSY 5    // Freq sync / update strobe
 
+// SPI clock, the AD9834's rated maximum (the RP2040 rounds down to the nearest divider of clk_peri)
+#define AD9834_SPI_BAUD 40000000
+
 // Must be a pin capable of outputting a clock source directly
 #define AD9834_REF 21   // Square wave frequency reference
 
 // Initializes the AD9834 board and starts the reference clock.
 void ad9834_init();
 
+// Frequency registers are 28 bits, in steps of MCLK/2^28 (about 0.28Hz), written as two 14-bit halves
+#define AD9834_FREQ_WORD_MASK 0xFFFFFFF
+#define AD9834_FREQ_LSW(word) ((uint16_t) ((word) & 0x3FFF))
+#define AD9834_FREQ_MSW(word) ((uint16_t) (((word) & 0xFFFC000) >> 14))
+
 // Sets the frequency of the AD9834 board. Required to bring it out of RESET.
 void ad9834_setfreq(unsigned long int freq);
 
+// Sets the frequency from a tuning word, as from ad9834_freq_word
+void ad9834_setfreq_word(uint32_t freq_reg_val);
+
+// Sets the frequency from the halves of a tuning word, as split by AD9834_FREQ_LSW/AD9834_FREQ_MSW
+void ad9834_setfreq_halves(uint16_t lsw, uint16_t msw);
+
+// Frequency writes are queued by DMA and the functions above return before they reach the chip
+// (about 1.3us for the three words); this waits for them
+void ad9834_wait_idle();
+
+// Loads the halves of a tuning word into the idle frequency register without changing the output,
+// so that ad9834_select_preloaded can switch to it with a single control write
+void ad9834_preload_halves(uint16_t lsw, uint16_t msw);
+void ad9834_select_preloaded();
+
+// Converts between frequencies in Hz and tuning words
+uint32_t ad9834_freq_word(double freq);
+double ad9834_word_freq(uint32_t freq_reg_val);
+
 #endif
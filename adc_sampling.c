@@ -1,39 +1,119 @@
 #include "adc_sampling.h"
 #include <hardware/adc.h>
-#include <hardware/dma.h>
 #include "math.h"
 #include <stdio.h>
 #include <hardware/clocks.h>
 #include <pico/stdlib.h>
 #include "complex_math.h"
+#include "adc_stream.h"
+
+// Cached filter kernels
+typedef struct {
+    bool valid;
+    double center, width;
+    uint32_t last_used;
+    fir_coef_t h[FIR_N];
+    int16_t h_q[FIR_N];     // h in Q(FIR_Q_SHIFT) of the center tap
+} fir_cache_entry_t;
+
+static fir_cache_entry_t fir_cache[FIR_CACHE_SIZE];
+static uint32_t fir_cache_clock = 0;
+
+// Kernel used by convolve, and its integer taps and their scale for convolve_valid
+static const fir_coef_t *fir_h = NULL;
+static const int16_t *fir_h_q = NULL;
+static double fir_q_scale;
+
+#ifdef FIR_CONST_TABLE
+#if FIR_N != 64
+#error "The const FIR table is written out for FIR_N == 64"
+#endif
+// The same h[n] as gen_fir_h at the IF; GCC folds the trig builtins on constant arguments
+#define FIR_X(n) (2.0*MATH_PI*FIR_IF_WIDTH*((n) - FIR_N/2))
+#define FIR_TAP(n) ((fir_coef_t) (2.0*MATH_PI*FIR_IF_WIDTH \
+    * ((n) == FIR_N/2 ? 1.0 : __builtin_sin(FIR_X(n)) / FIR_X(n)) \
+    * __builtin_cos(2.0*MATH_PI*FIR_IF_CENTER*((n) - FIR_N/2))))
+#define FIR_TAPS8(n) FIR_TAP(n), FIR_TAP(n+1), FIR_TAP(n+2), FIR_TAP(n+3), \
+                     FIR_TAP(n+4), FIR_TAP(n+5), FIR_TAP(n+6), FIR_TAP(n+7)
+static const fir_coef_t fir_h_if[FIR_N] = {
+    FIR_TAPS8(0), FIR_TAPS8(8), FIR_TAPS8(16), FIR_TAPS8(24),
+    FIR_TAPS8(32), FIR_TAPS8(40), FIR_TAPS8(48), FIR_TAPS8(56)
+};
+
+#undef FIR_TAP
+#define FIR_TAP_H(n) (((n) == FIR_N/2 ? 1.0 : __builtin_sin(FIR_X(n)) / FIR_X(n)) \
+    * __builtin_cos(2.0*MATH_PI*FIR_IF_CENTER*((n) - FIR_N/2)) * (1 << FIR_Q_SHIFT))
+#define FIR_TAP(n) ((int16_t) (FIR_TAP_H(n) + (FIR_TAP_H(n) < 0 ? -0.5 : 0.5)))
+static const int16_t fir_h_q_if[FIR_N] = {
+    FIR_TAPS8(0), FIR_TAPS8(8), FIR_TAPS8(16), FIR_TAPS8(24),
+    FIR_TAPS8(32), FIR_TAPS8(40), FIR_TAPS8(48), FIR_TAPS8(56)
+};
+#endif
+
+static uint16_t dma_buf[NUM_DUAL_SAMPLES];  // Large enough for a dual capture
+static double y_buf[NUM_SAMPLES + FIR_N - 1];
 
-static int fir_n[FIR_N];
-static double fir_h[FIR_N];
+#if ADC_TOTAL_SAMPLE_RATE % ADC_INPUT_FREQ != 0
+#error "calc_phasor_dft needs a whole number of conversions per IF period"
+#endif
 
-static uint16_t dma_buf[NUM_SAMPLES];
-static double y_buf[NUM_SAMPLES + FIR_N - 1];
+// cos and sin of the IF phase at each conversion of a period, in Q14
+static int16_t if_cos[IF_PERIOD_CONVERSIONS];
+static int16_t if_sin[IF_PERIOD_CONVERSIONS];
+static bool if_twiddles_ready = false;
+
+static rx_amplitude_method_t amplitude_method = RX_AMPLITUDE_FIR;
 
 static inline double sinc(double x) {
     if(x == 0) return 1;
     return sin(x) / x;
 }
 
-// Puts an h[n] for a given center and width of bandpass filter into fir_h
-static void gen_fir_h(double center, double width) {
-    // Frequencies of step function offsets
-    double f0 = center - width / 2.0;
-    double f1 = center + width / 2.0;
+// Selects the h[n] for a given center and width of bandpass filter as fir_h, generating it into
+// the least recently used cache entry unless it is cached
+void gen_fir_h(double center, double width) {
+#ifdef FIR_CONST_TABLE
+    if(center == FIR_IF_CENTER && width == FIR_IF_WIDTH) {
+        fir_h = fir_h_if;
+        fir_h_q = fir_h_q_if;
+        fir_q_scale = 2.0*MATH_PI*width / (1 << FIR_Q_SHIFT);
+        return;
+    }
+#endif
+
+    fir_cache_entry_t *entry = &fir_cache[0];
+    for(int e = 0; e < FIR_CACHE_SIZE; e++) {
+        if(fir_cache[e].valid && fir_cache[e].center == center && fir_cache[e].width == width) {
+            fir_cache[e].last_used = ++fir_cache_clock;
+            fir_h = fir_cache[e].h;
+            fir_h_q = fir_cache[e].h_q;
+            fir_q_scale = 2.0*MATH_PI*width / (1 << FIR_Q_SHIFT);
+            return;
+        }
+        if(!fir_cache[e].valid || (entry->valid && fir_cache[e].last_used < entry->last_used))
+            entry = &fir_cache[e];
+    }
 
     // Generate impulse response with which to convolve x[n]
     for(int i = 0; i < FIR_N; i++) {
-        fir_n[i] = i - (FIR_N/2);
-        fir_h[i] = 2.0*MATH_PI*width*sinc(2.0*MATH_PI*width*fir_n[i]) * cos(2.0*MATH_PI*center*fir_n[i]);
+        int n = i - (FIR_N/2);
+        double h = sinc(2.0*MATH_PI*width*n) * cos(2.0*MATH_PI*center*n);  // Relative to the center tap
+        entry->h[i] = 2.0*MATH_PI*width*h;
+        entry->h_q[i] = (int16_t) lround(h * (1 << FIR_Q_SHIFT));
     }
+
+    entry->valid = true;
+    entry->center = center;
+    entry->width = width;
+    entry->last_used = ++fir_cache_clock;
+    fir_h = entry->h;
+    fir_h_q = entry->h_q;
+    fir_q_scale = 2.0*MATH_PI*width / (1 << FIR_Q_SHIFT);
 }
 
-// Convolves whatever is in buf with the kernel in fir_h and stores the result in y_buf
+// Convolves samples with the kernel in fir_h and stores the result in y_buf
 // y(n) = ∑​f(k)*h(n−k)
-static void convolve() {
+void convolve(const uint16_t *samples) {
     // Init out buffer
     int outlen = NUM_SAMPLES + FIR_N - 1;
     for(int i = 0; i < outlen; i++) {
@@ -44,81 +124,141 @@ static void convolve() {
     for(int n = 0; n < outlen; n++) {
         int maxk = imin(FIR_N, n);
         for(int k = 0; k < maxk; k++) {
-            y_buf[n] = y_buf[n] + ((double)dma_buf[n - k]) * fir_h[k];
+            y_buf[n] = y_buf[n] + ((double)samples[n - k]) * fir_h[k];
         }
     }
 }
 
+#if FIR_N % 4 != 0
+#error "convolve_valid's inner loop is unrolled by 4"
+#endif
+
+// Convolves the mean-removed samples with fir_h_q, only for the outputs that are used
+// y(n) = ∑​f(n−k)*h(k), for n = FIR_VALID_FIRST, FIR_VALID_FIRST + decim, ... before FIR_VALID_END
+int convolve_valid(const uint16_t *samples, int decim, double *out) {
+    // The filter is a band-pass, so the mean only costs headroom
+    int32_t sum = 0;
+    for(int i = 0; i < NUM_SAMPLES; i++) sum += samples[i];
+    int32_t mean = sum / NUM_SAMPLES;
+
+    int num_out = 0;
+    for(int n = FIR_VALID_FIRST; n < FIR_VALID_END; n = n + decim) {
+        const uint16_t *x = &samples[n];
+        int32_t acc = 0;
+        for(int k = 0; k < FIR_N; k = k + 4) {
+            acc += ((int32_t)x[-k] - mean) * fir_h_q[k];
+            acc += ((int32_t)x[-k-1] - mean) * fir_h_q[k+1];
+            acc += ((int32_t)x[-k-2] - mean) * fir_h_q[k+2];
+            acc += ((int32_t)x[-k-3] - mean) * fir_h_q[k+3];
+        }
+        out[num_out++] = acc * fir_q_scale;
+    }
+    return num_out;
+}
+
 void rx_adc_init() {
     adc_gpio_init(ADC_I);
     adc_gpio_init(ADC_Q);
     adc_init();
+    adc_stream_init();
+    gen_fir_h(FIR_IF_CENTER, FIR_IF_WIDTH);  // Have the kernel at the IF ready
     // printf("Initialized ADC.\n\r");
 }
 
+// Hands the second detector's pins to the ADC, for dual captures
+void rx_adc_init_dual() {
+    adc_gpio_init(ADC_RFL_I);
+    adc_gpio_init(ADC_RFL_Q);
+}
+
+// Streams I/Q blocks of the inputs in rr_mask, unless already doing so
+void rx_adc_stream_iq(uint32_t rr_mask) {
+    adc_stream_ensure(rr_mask, ADC_I, RX_BLOCK_SAMPLES(rr_mask));
+}
+
+// Restarts the I/Q stream of the inputs in rr_mask from when dreq fires
+void rx_adc_stream_iq_on_dreq(uint32_t rr_mask, uint dreq) {
+    adc_stream_start_on_dreq(rr_mask, ADC_I, RX_BLOCK_SAMPLES(rr_mask), dreq);
+}
+
+// Reads the next I/Q capture of the inputs in rr_mask from the stream, undeinterleaved
+void rx_adc_capture_iq(uint32_t rr_mask, uint16_t *samples) {
+    rx_adc_stream_iq(rr_mask);
+    adc_stream_read(samples, rr_mask == ADC_DUAL_RR_MASK ? NUM_DUAL_SAMPLES : NUM_SAMPLES);
+}
+
 // Take interleaved (round-robin samples and then separate into two separate arrays) I, Q samples
 // Specifically, takes NUM_SAMPLES total samples
-void take_interleaved_iq_samples(double *I_samples, double *Q_samples) {
-    // Set up ADC for this sampling
-    adc_set_round_robin(ADC_RR_MASK);
-    adc_select_input(ADC_I - 26);  // Start with I signal
-    adc_fifo_setup(true, true, 1, false, false);
-    adc_set_clkdiv(0);  // Sample at full speed
-
-    // Set up ADC DMA channel
-    uint dma_ch = dma_claim_unused_channel(true);
-    dma_channel_config cfg = dma_channel_get_default_config(dma_ch);
-
-    // Based on https://github.com/raspberrypi/pico-examples/blob/master/adc/dma_capture/dma_capture.c
-    // Reading from constant address, writing to incrementing byte addresses
-    channel_config_set_transfer_data_size(&cfg, DMA_SIZE_16);
-    channel_config_set_read_increment(&cfg, false);
-    channel_config_set_write_increment(&cfg, true);
-    // Pace transfers based on availability of ADC samples
-    channel_config_set_dreq(&cfg, DREQ_ADC);
-    dma_channel_configure(dma_ch, &cfg,
-        dma_buf,    // dst
-        &adc_hw->fifo,  // src
-        NUM_SAMPLES,  // transfer count
-        true            // start immediately
-    );
-
-    // Start the capture
-    adc_select_input(ADC_I - 26);  // Start with I signal
-    adc_run(true);
-    dma_channel_wait_for_finish_blocking(dma_ch);
-    adc_run(false);
-    adc_fifo_drain();
-    dma_channel_cleanup(dma_ch);
-    dma_channel_unclaim(dma_ch);
+void take_interleaved_iq_samples(dsp_sample_t *I_samples, dsp_sample_t *Q_samples) {
+    rx_adc_capture_iq(ADC_RR_MASK, dma_buf);
+    deinterleave_iq_samples(dma_buf, I_samples, Q_samples);
+}
+
+// Takes incident and reflected I, Q samples in one round-robin capture of all four ADC inputs
+void take_dual_iq_samples(dsp_sample_t *ref_I, dsp_sample_t *ref_Q, dsp_sample_t *rfl_I, dsp_sample_t *rfl_Q) {
+    rx_adc_capture_iq(ADC_DUAL_RR_MASK, dma_buf);
+    deinterleave_dual_iq_samples(dma_buf, ref_I, ref_Q, rfl_I, rfl_Q);
+}
+
+// Takes a short burst of the inputs in rr_mask and measures the level of each I/Q pair
+void rx_adc_burst_levels(uint32_t rr_mask, double *levels) {
+    int num_inputs = rr_mask == ADC_DUAL_RR_MASK ? 4 : 2;
+    int num_samples = RX_BLOCK_SAMPLES(rr_mask);  // Whole IF periods of each input
+    rx_adc_stream_iq(rr_mask);
+    const uint16_t *block = adc_stream_next_block(NULL);
+
+    for(int pair = 0; pair < num_inputs / 2; pair++) {
+        // Variance of I plus variance of Q is the squared amplitude of the IF tone
+        double var = 0.0;
+        for(int c = 2*pair; c < 2*pair + 2; c++) {
+            int32_t sum = 0;
+            int64_t sumsq = 0;
+            int n = 0;
+            for(int i = c; i < num_samples; i = i + num_inputs) {
+                sum += block[i];
+                sumsq += (int32_t)block[i] * block[i];
+                n++;
+            }
+            var += (double)(n*sumsq - (int64_t)sum*sum) / ((double)n*n);
+        }
+        levels[pair] = sqrt(var);
+    }
+}
+
+// Average of every stride'th sample from first up to end, in the units of dsp_from_adc's bias
+static dsp_acc_t capture_bias(const uint16_t *samples, int first, int stride, int end) {
+    dsp_acc_t bias = 0;
+    int num_samples = 0;
+    for(int i = first; i < end; i = i + stride) {
+        bias += samples[i];
+        num_samples++;
+    }
+#if DSP_NUMERIC == DSP_Q15
+    // Keep the fractional part of the bias, rounded to the nearest Q15 step
+    return ((bias << DSP_Q15_SHIFT) + num_samples/2) / num_samples;
+#else
+    return bias / num_samples;
+#endif
+}
 
+// Removes bias from a capture of NUM_SAMPLES interleaved I, Q samples and separates it into
+// I and Q arrays, holding each sample for two slots
+void deinterleave_iq_samples(const uint16_t *samples, dsp_sample_t *I_samples, dsp_sample_t *Q_samples) {
     // FOR FFT METHOD:
     // Save I and Q data, with a zero any time the other side was measuring
     // for(int i = 0; i < NUM_SAMPLES; i++) {
     //     if (i % 2 == 0)  {  // Even => I
-    //         I_samples[i] = dma_buf[i];
+    //         I_samples[i] = samples[i];
     //         Q_samples[i] = 0.0;
     //     } else {            // Odd  => Q
     //         I_samples[i] = 0.0;
-    //         Q_samples[i] = dma_buf[i];
+    //         Q_samples[i] = samples[i];
     //     }
     // }
 
     // Find bias (average) of each signal to remove it
-    double i_bias = 0.0;
-    double q_bias = 0.0;
-    int num_i_samples = 0;
-    int num_q_samples = 0;
-    for(int i = NUM_SAMPLES-NUM_SAMPLES_PROCESSED; i < NUM_SAMPLES; i = i + 2) {
-        i_bias += dma_buf[i];
-        num_i_samples++;
-    }
-    for(int i = NUM_SAMPLES-NUM_SAMPLES_PROCESSED + 1; i < NUM_SAMPLES; i = i + 2) {
-        q_bias += dma_buf[i];
-        num_q_samples++;
-    }
-    i_bias = (double)i_bias / num_i_samples;
-    q_bias = (double)q_bias / num_q_samples;
+    dsp_acc_t i_bias = capture_bias(samples, NUM_SAMPLES-NUM_SAMPLES_PROCESSED, 2, NUM_SAMPLES);
+    dsp_acc_t q_bias = capture_bias(samples, NUM_SAMPLES-NUM_SAMPLES_PROCESSED + 1, 2, NUM_SAMPLES);
     // i_bias = (double)(2048);   // Constant bias assumption does not work.
     // q_bias = (double)(2048);
 
@@ -126,22 +266,23 @@ void take_interleaved_iq_samples(double *I_samples, double *Q_samples) {
     // This only operates on a region at the end of the data, to avoid
     // compensating for transients and pre-steady-state behavior
     // for(int i = 0; i < NUM_SAMPLES; i = i + 2)
-        // I_samples[i/2] = ((double)dma_buf[i]) - i_bias;
+        // I_samples[i/2] = ((double)samples[i]) - i_bias;
     // for(int i = 1; i < NUM_SAMPLES; i = i + 2)
-        // Q_samples[i/2] = ((double)dma_buf[i]) - q_bias;
+        // Q_samples[i/2] = ((double)samples[i]) - q_bias;
 
     // Save I and Q data
     for(int i = 0; i < NUM_SAMPLES-1; i++) {
         if (i % 2 == 0)  {  // Even => I
-            I_samples[i] = (double)dma_buf[i] - i_bias;
-            I_samples[i+1] = (double)dma_buf[i] - i_bias;
+            I_samples[i] = dsp_from_adc(samples[i], i_bias);
+            I_samples[i+1] = I_samples[i];
             // Q_samples[i] = 0.0;
         } else {            // Odd  => Q
             // I_samples[i] = 0.0;
-            Q_samples[i] = (double)dma_buf[i] - q_bias;
-            Q_samples[i+1] = (double)dma_buf[i] - q_bias;
+            Q_samples[i] = dsp_from_adc(samples[i], q_bias);
+            Q_samples[i+1] = Q_samples[i];
         }
     }
+    Q_samples[NUM_SAMPLES-1] = dsp_from_adc(samples[NUM_SAMPLES-1], q_bias);  // The last Q sample has no next slot to share
 
     // Filter I and Q data
     // gen_fir_h(((double) ADC_INPUT_FREQ) / 500, ((double) FIR_WIDTH) / 500);
@@ -152,100 +293,184 @@ void take_interleaved_iq_samples(double *I_samples, double *Q_samples) {
 
 }
 
-double_cplx_t calc_phasor(double *I_samples, double *Q_samples) {
-    double total_I = 0.0;
-    double total_Q = 0.0;
+// Views of the I and Q inputs of a raw capture, matching deinterleave_iq_samples: I is held from
+// each even conversion, Q from each odd one
+void iq_views(const uint16_t *samples, iq_view_t *I_view, iq_view_t *Q_view) {
+    *I_view = (iq_view_t) {samples, 0, 2, 0,
+        capture_bias(samples, NUM_SAMPLES-NUM_SAMPLES_PROCESSED, 2, NUM_SAMPLES)};
+    *Q_view = (iq_view_t) {samples, 1, 2, 1,
+        capture_bias(samples, NUM_SAMPLES-NUM_SAMPLES_PROCESSED + 1, 2, NUM_SAMPLES)};
+}
+
+// Views of the four inputs of a dual capture, matching deinterleave_dual_iq_samples: input c of
+// slots i and i+1 (i even) is conversion 2*i + c
+void dual_iq_views(const uint16_t *samples, iq_view_t *ref_I, iq_view_t *ref_Q, iq_view_t *rfl_I, iq_view_t *rfl_Q) {
+    iq_view_t *views[4] = {ref_I, ref_Q, rfl_I, rfl_Q};
+
+    for(int c = 0; c < 4; c++) {
+        dsp_acc_t bias = capture_bias(samples, NUM_DUAL_SAMPLES - 2*NUM_SAMPLES_PROCESSED + c, 4, NUM_DUAL_SAMPLES);
+        *views[c] = (iq_view_t) {samples, c, 4, 0, bias};
+    }
+}
+
+// Removes bias from a four-way interleaved capture (incident I, Q, reflected I, Q) and separates
+// it into four arrays of NUM_SAMPLES slots, holding each sample for two slots
+void deinterleave_dual_iq_samples(const uint16_t *samples, dsp_sample_t *ref_I, dsp_sample_t *ref_Q,
+                                  dsp_sample_t *rfl_I, dsp_sample_t *rfl_Q) {
+    dsp_sample_t *out[4] = {ref_I, ref_Q, rfl_I, rfl_Q};
+
+    for(int c = 0; c < 4; c++) {
+        // Bias over the same region that will be processed, as for a single-path capture
+        dsp_acc_t bias = capture_bias(samples, NUM_DUAL_SAMPLES - 2*NUM_SAMPLES_PROCESSED + c, 4, NUM_DUAL_SAMPLES);
+
+        for(int i = 0; i < NUM_SAMPLES; i = i + 2) {
+            out[c][i] = dsp_from_adc(samples[2*i + c], bias);
+            out[c][i+1] = out[c][i];
+        }
+    }
+}
+
+double_cplx_t calc_phasor(dsp_sample_t *I_samples, dsp_sample_t *Q_samples) {
+    dsp_acc_t total_I = 0;
+    dsp_acc_t total_Q = 0;
 
     for(int i = NUM_SAMPLES - NUM_SAMPLES_PROCESSED; i < NUM_SAMPLES; i++) { // For each (I,Q) pair
         total_I += I_samples[i];
         total_Q += Q_samples[i];
     }
 
-    return (double_cplx_t) {total_I / NUM_SAMPLES_PROCESSED, total_Q / NUM_SAMPLES_PROCESSED};
+    return (double_cplx_t) {DSP_COUNTS(total_I) / NUM_SAMPLES_PROCESSED, DSP_COUNTS(total_Q) / NUM_SAMPLES_PROCESSED};
+
+}
+
+double_cplx_t calc_phasor_view(const iq_view_t *I_view, const iq_view_t *Q_view) {
+    dsp_acc_t total_I = 0;
+    dsp_acc_t total_Q = 0;
+
+    for(int i = NUM_SAMPLES - NUM_SAMPLES_PROCESSED; i < NUM_SAMPLES; i++) { // For each (I,Q) pair
+        total_I += iq_view_at(I_view, i);
+        total_Q += iq_view_at(Q_view, i);
+    }
+
+    return (double_cplx_t) {DSP_COUNTS(total_I) / NUM_SAMPLES_PROCESSED, DSP_COUNTS(total_Q) / NUM_SAMPLES_PROCESSED};
+}
+
+static void gen_if_twiddles() {
+    for(int k = 0; k < IF_PERIOD_CONVERSIONS; k++) {
+        double theta = 2.0*MATH_PI*k / IF_PERIOD_CONVERSIONS;
+        if_cos[k] = (int16_t) lround(cos(theta) * (1 << IF_TWIDDLE_SHIFT));
+        if_sin[k] = (int16_t) lround(sin(theta) * (1 << IF_TWIDDLE_SHIFT));
+    }
+    if_twiddles_ready = true;
+}
+
+// DFT bin at the IF of the conversions first, first + stride, ... before end, each multiplied
+// by e^(-j*theta) at its own time. Returns the bin divided by the number of conversions.
+static double_cplx_t dft_if_bin(const uint16_t *samples, int first, int stride, int end) {
+    int32_t acc_c = 0, acc_s = 0;               // sum(x*cos), sum(x*sin)
+    int32_t sum_x = 0, sum_c = 0, sum_s = 0;    // For removing the mean
+    int n = 0;
+    int k = first % IF_PERIOD_CONVERSIONS;
+
+    for(int i = first; i < end; i = i + stride) {
+        int32_t x = (int32_t)samples[i] - 2048;  // Centered, so the products stay well inside 32 bits
+        acc_c += x * if_cos[k];
+        acc_s += x * if_sin[k];
+        sum_x += x;
+        sum_c += if_cos[k];
+        sum_s += if_sin[k];
+        n++;
+        k = k + stride;  // stride is less than a period
+        if(k >= IF_PERIOD_CONVERSIONS) k -= IF_PERIOD_CONVERSIONS;
+    }
 
+    // sum((x - mean)*w) = sum(x*w) - sum(x)*sum(w)/n
+    const double scale = 1.0 / (1 << IF_TWIDDLE_SHIFT);
+    double re = (acc_c - (double)sum_x * sum_c / n) * scale;
+    double im = -(acc_s - (double)sum_x * sum_s / n) * scale;
+    return (double_cplx_t) {re / n, im / n};
+}
+
+// Phasor of the IF tone on an I/Q pair of a capture, by a single-bin DFT
+// For I = A*cos(wt + p) and Q = A*sin(wt + p), the bins are A/2*e^(jp) and -j*A/2*e^(jp), so
+// I + jQ gives A*e^(jp).
+double_cplx_t calc_phasor_dft(const uint16_t *samples, uint32_t rr_mask, int pair) {
+    if(!if_twiddles_ready) gen_if_twiddles();
+
+    int num_inputs = rr_mask == ADC_DUAL_RR_MASK ? 4 : 2;
+    int end = rr_mask == ADC_DUAL_RR_MASK ? NUM_DUAL_SAMPLES : NUM_SAMPLES;
+    int first = end - NUM_SAMPLES_PROCESSED * num_inputs / 2 + 2*pair;
+
+    double_cplx_t i_bin = dft_if_bin(samples, first, num_inputs, end);
+    double_cplx_t q_bin = dft_if_bin(samples, first + 1, num_inputs, end);
+    return (double_cplx_t) {i_bin.a - q_bin.b, i_bin.b + q_bin.a};
+}
+
+// RMS amplitude of one frequency component, by the Goertzel algorithm
+// s[n] = x[n] + 2cos(w)*s[n-1] - s[n-2], with the coefficient in Q14 and the samples in Q4
+// after removing their mean
+double goertzel_rms(const uint16_t *samples, int num_samples, double freq) {
+    const int coef_shift = 14;
+    int32_t coef = (int32_t) lround(2.0*cos(2.0*MATH_PI*freq) * (1 << coef_shift));
+
+    int32_t sum = 0;
+    for(int i = 0; i < num_samples; i++) sum += samples[i];
+    int32_t mean = ((sum << 4) + num_samples/2) / num_samples;
+
+    int64_t s1 = 0, s2 = 0;
+    for(int i = 0; i < num_samples; i++) {
+        int64_t s0 = (((int32_t)samples[i] << 4) - mean) + ((coef * s1) >> coef_shift) - s2;
+        s2 = s1;
+        s1 = s0;
+    }
+
+    // |X|^2 = s1^2 + s2^2 - 2cos(w)*s1*s2, and a sinusoid of RMS r gives |X| = r*N/sqrt(2)
+    double a = s1 / 16.0, b = s2 / 16.0;
+    double mag2 = a*a + b*b - (double)coef / (1 << coef_shift) * a*b;
+    return sqrt(2.0 * fmax(mag2, 0.0)) / num_samples;
+}
+
+// Captures NUM_SAMPLES conversions of a single pin into dma_buf, as 8-bit samples
+static void capture_single(int adc_pin) {
+    adc_stream_start(0x00, adc_pin, NUM_SAMPLES_PROCESSED);
+    adc_stream_read(dma_buf, NUM_SAMPLES);
+    adc_stream_stop();
+
+    for(int i = 0; i < NUM_SAMPLES; i++) dma_buf[i] >>= 4;
+}
+
+// Selects how rx_adc_get_amplitude_blocking filters
+void rx_adc_set_amplitude_method(rx_amplitude_method_t method) {
+    amplitude_method = method;
 }
 
 double rx_adc_get_amplitude_blocking(int adc_pin, double freq) {
-    // Set up ADC FIFO
-    adc_set_round_robin(0x00);
-    adc_select_input(adc_pin - 26);
-    adc_fifo_setup(true, true, 1, false, true);
-    adc_set_clkdiv(0);
-
-    // Set up ADC DMA channel
-    uint dma_ch = dma_claim_unused_channel(true);
-    dma_channel_config cfg = dma_channel_get_default_config(dma_ch);
-
-    // Based on https://github.com/raspberrypi/pico-examples/blob/master/adc/dma_capture/dma_capture.c
-    // Reading from constant address, writing to incrementing byte addresses
-    channel_config_set_transfer_data_size(&cfg, DMA_SIZE_16);
-    channel_config_set_read_increment(&cfg, false);
-    channel_config_set_write_increment(&cfg, true);
-    // Pace transfers based on availability of ADC samples
-    channel_config_set_dreq(&cfg, DREQ_ADC);
-    dma_channel_configure(dma_ch, &cfg,
-        dma_buf,    // dst
-        &adc_hw->fifo,  // src
-        NUM_SAMPLES,  // transfer count
-        true            // start immediately
-    );
-
-    // Start the capture
-    adc_run(true);
-    dma_channel_wait_for_finish_blocking(dma_ch);
-    adc_run(false);
-    adc_fifo_drain();
-    dma_channel_cleanup(dma_ch);
-    dma_channel_unclaim(dma_ch);
-
-    // Generate the FIR response with which to convolve the samples
-    gen_fir_h(((double) freq) / 500, ((double) FIR_WIDTH) / 500);
-
-    // Convolve the samples with the FIR response to get filtered data
-    convolve();
-
-    // Find scaled RMS voltage, discarding first and last FIR_N*2 many samples
+    capture_single(adc_pin);
+
+    if(amplitude_method == RX_AMPLITUDE_GOERTZEL)
+        return goertzel_rms(dma_buf, NUM_SAMPLES, freq / ADC_TOTAL_SAMPLE_RATE);
+
+    // Select the FIR response with which to convolve the samples (cached after the first call)
+    gen_fir_h(((double) freq) / ADC_TOTAL_SAMPLE_RATE, ((double) FIR_WIDTH) / ADC_TOTAL_SAMPLE_RATE);
+
+    // Convolve the samples with the FIR response to get the filtered data that is used,
+    // discarding first and last FIR_N many samples. At the IF only a few per period are needed.
+    int decim = freq == ADC_INPUT_FREQ ? FIR_IF_DECIMATION : 1;
+    int num_out = convolve_valid(dma_buf, decim, y_buf);
+
+    // Find scaled RMS voltage
     double sumsq = 0.0;
-    for(int i = FIR_N; i < NUM_SAMPLES - FIR_N; i++) {
+    for(int i = 0; i < num_out; i++) {
         sumsq = sumsq + y_buf[i] * y_buf[i];
     }
 
-    double rms = sqrt(sumsq / (NUM_SAMPLES - FIR_N*2));
+    double rms = sqrt(sumsq / num_out);
     return rms;  // Return rms
 }
 
 
 double rx_adc_get_pp_unfiltered_blocking(int adc_pin) {
-    // Set up ADC FIFO
-    adc_select_input(adc_pin - 26);
-    adc_fifo_setup(true, true, 1, false, true);
-    adc_set_clkdiv(0);
-
-    // Set up ADC DMA channel
-    uint dma_ch = dma_claim_unused_channel(true);
-    dma_channel_config cfg = dma_channel_get_default_config(dma_ch);
-
-    // Based on https://github.com/raspberrypi/pico-examples/blob/master/adc/dma_capture/dma_capture.c
-    // Reading from constant address, writing to incrementing byte addresses
-    channel_config_set_transfer_data_size(&cfg, DMA_SIZE_16);
-    channel_config_set_read_increment(&cfg, false);
-    channel_config_set_write_increment(&cfg, true);
-    // Pace transfers based on availability of ADC samples
-    channel_config_set_dreq(&cfg, DREQ_ADC);
-    dma_channel_configure(dma_ch, &cfg,
-        dma_buf,            // dst
-        &adc_hw->fifo,  // src
-        NUM_SAMPLES,    // transfer count
-        true            // start immediately
-    );
-
-    // Start the capture
-    adc_run(true);
-    dma_channel_wait_for_finish_blocking(dma_ch);
-    adc_run(false);
-    adc_fifo_drain();
-    dma_channel_cleanup(dma_ch);
-    dma_channel_unclaim(dma_ch);
+    capture_single(adc_pin);
 
     // Figure out max and min of signal to subtract
     uint16_t max = dma_buf[0];
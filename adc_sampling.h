@@ -5,6 +5,8 @@
 #ifndef ADC_SAMPLING_H
 #define ADC_SAMPLING_H
 
+#include <stdint.h>
+#include <pico.h>
 #include "complex_math.h"
 
 // Sampling and filtering parameters
@@ -14,35 +16,204 @@
 // Hardware parameter
 #define ADC_TOTAL_SAMPLE_RATE 500
 
-// All other samples are discarded
-#define NUM_SAMPLES_PROCESSED ((double) ADC_TOTAL_SAMPLE_RATE / (double) ADC_INPUT_FREQ) * 2.0
+// All other samples are discarded (two periods of the IF)
+#define NUM_SAMPLES_PROCESSED (2 * ADC_TOTAL_SAMPLE_RATE / ADC_INPUT_FREQ)
 
 #define FIR_N 64
 #define FIR_WIDTH 0.1  // kHz
 
+// Kernels from gen_fir_h are cached by center and width, FIR_CACHE_SIZE at a time (least recently
+// used replaced first), in a compact float format.
+// Building with FIR_CONST_TABLE (SUPERVNA_FIR_CONST_TABLE in CMake) also puts the kernel at the IF
+// into flash as a const table computed by the compiler, so it never needs generating.
+#define FIR_CACHE_SIZE 4
+typedef float fir_coef_t;
+
+// convolve_valid's integer taps: h[n] in Q12 of the center tap (2*pi*width, the largest),
+// so a tap times a 12-bit sample summed over FIR_N taps stays inside 32 bits
+#define FIR_Q_SHIFT 12
+
+// Filtered samples that rx_adc_get_amplitude_blocking takes the RMS of: from FIR_N to
+// NUM_SAMPLES - FIR_N, where the kernel fully overlaps the capture
+#define FIR_VALID_FIRST FIR_N
+#define FIR_VALID_END (NUM_SAMPLES - FIR_N)
+
+// Decimation of the filtered samples at the IF: five per IF period, so that the ones kept still
+// cover whole periods evenly and their RMS is that of the tone
+#define FIR_IF_DECIMATION 5
+
+// Normalized center and width of the kernel at the IF
+#define FIR_IF_CENTER (((double) ADC_INPUT_FREQ) / ADC_TOTAL_SAMPLE_RATE)
+#define FIR_IF_WIDTH (((double) FIR_WIDTH) / ADC_TOTAL_SAMPLE_RATE)
+
 // GPIO for I and Q ADC inputs
 #define ADC_I 26 
 #define ADC_Q 27
 #define ADC_RR_MASK 0x03  // Bits 0 and 1, for 26 and 27
 
+// GPIO for the I and Q outputs of a second detector on the reflected path, captured together
+// with ADC_I and ADC_Q (incident) by take_dual_iq_samples. Only set up by rx_adc_init_dual: on a
+// stock Pico GPIO29 senses VSYS/3, so this needs a board with GPIO28 and GPIO29 free.
+#define ADC_RFL_I 28
+#define ADC_RFL_Q 29
+#define ADC_DUAL_RR_MASK 0x0F  // All four inputs: incident I, Q, reflected I, Q
+
+// Conversions in a dual capture: NUM_SAMPLES slots per path, each slot twice as long as in
+// take_interleaved_iq_samples, so NUM_SAMPLES_PROCESSED still spans a whole number of IF periods
+#define NUM_DUAL_SAMPLES (2 * NUM_SAMPLES)
+
+// I/Q captures are read from the ADC stream (adc_stream.h) in blocks of NUM_SAMPLES_PROCESSED
+// slots of each input, i.e. whole IF periods, so every block starts on ADC_I
+#define RX_BLOCK_SAMPLES(rr_mask) ((rr_mask) == ADC_DUAL_RR_MASK ? 2 * NUM_SAMPLES_PROCESSED : NUM_SAMPLES_PROCESSED)
+#define RX_BLOCK_US(rr_mask) (RX_BLOCK_SAMPLES(rr_mask) * 1000 / ADC_TOTAL_SAMPLE_RATE)
+
+// Numeric type of the per-sample DSP (sample buffers, bias removal, phasor and gamma accumulation).
+// Doubles are software-emulated on the RP2040, so FLOAT or Q15 make each point much cheaper.
+// Select with -DDSP_NUMERIC=DSP_FLOAT etc. (SUPERVNA_DSP_NUMERIC in CMake).
+#define DSP_DOUBLE 0
+#define DSP_FLOAT 1
+#define DSP_Q15 2   // Samples in Q15 (1.0 = 2048 ADC counts), 32/64-bit integer accumulators
+
+#ifndef DSP_NUMERIC
+#define DSP_NUMERIC DSP_DOUBLE
+#endif
+
+#if DSP_NUMERIC == DSP_Q15
+typedef int16_t dsp_sample_t;
+typedef int32_t dsp_acc_t;
+#define DSP_Q15_SHIFT 4     // ADC counts to Q15
+#define DSP_NUMERIC_NAME "q15"
+#define DSP_COUNTS(x) ((double)(x) / (1 << DSP_Q15_SHIFT))
+#define dsp_from_adc(x, bias) dsp_sat16(((int32_t)(x) << DSP_Q15_SHIFT) - (bias))
+static inline int16_t dsp_sat16(int32_t x) {
+    return x > INT16_MAX ? INT16_MAX : (x < INT16_MIN ? INT16_MIN : x);
+}
+#elif DSP_NUMERIC == DSP_FLOAT
+typedef float dsp_sample_t;
+typedef float dsp_acc_t;
+#define DSP_NUMERIC_NAME "float"
+#define DSP_COUNTS(x) ((double)(x))
+#define dsp_from_adc(x, bias) ((float)(x) - (bias))
+#else
+typedef double dsp_sample_t;
+typedef double dsp_acc_t;
+#define DSP_NUMERIC_NAME "double"
+#define DSP_COUNTS(x) ((double)(x))
+#define dsp_from_adc(x, bias) ((double)(x) - (bias))
+#endif
+
+// Strided view of one input of a raw round-robin capture, read as the sample-and-hold array that
+// deinterleave_iq_samples or deinterleave_dual_iq_samples would make of it, without copying:
+// slot i is samples[offset + step*((i - lag) >> 1)] less the input's bias. Only slots in the
+// processed region are read (slot 0 has no Q conversion before it).
+typedef struct {
+    const uint16_t *samples;
+    int offset;
+    int step;
+    int lag;
+    dsp_acc_t bias;     // As capture_bias finds it, in the units dsp_from_adc takes
+} iq_view_t;
+
+static inline dsp_sample_t iq_view_at(const iq_view_t *view, int i) {
+    return dsp_from_adc(view->samples[view->offset + view->step*((i - view->lag) >> 1)], view->bias);
+}
+
 // Math utilities
 #define MATH_PI 3.14159265359
 #define imin(a, b) (a < b) ? a : b
 #define imax(a, b) (a > b) ? a : b
 
+// Conversions per IF period; calc_phasor_dft's twiddles repeat with this period
+#define IF_PERIOD_CONVERSIONS (ADC_TOTAL_SAMPLE_RATE / ADC_INPUT_FREQ)
+#define IF_TWIDDLE_SHIFT 14     // Twiddles in Q14
+
+// Ways rx_adc_get_amplitude_blocking finds the amplitude of a frequency component
+typedef enum {
+    RX_AMPLITUDE_FIR,       // Band-pass FIR (gen_fir_h/convolve), RMS of the filtered signal (default)
+    RX_AMPLITUDE_GOERTZEL   // Goertzel single-bin DFT in integer arithmetic, RMS of the component itself
+} rx_amplitude_method_t;
+
 // Initialize the ADCs
 void rx_adc_init();
+// Sets up ADC_RFL_I and ADC_RFL_Q as ADC inputs too, for ADC_DUAL_RR_MASK captures
+void rx_adc_init_dual();
+
+// Streams I/Q blocks of the inputs in rr_mask (ADC_RR_MASK or ADC_DUAL_RR_MASK), unless already doing so.
+// The take_*_samples functions and rx_adc_burst_levels read the next blocks of this stream.
+void rx_adc_stream_iq(uint32_t rr_mask);
+
+// Restarts the I/Q stream of the inputs in rr_mask from when dreq fires (see adc_stream_start_on_dreq).
+// Block boundaries then keep a fixed IF phase relative to whatever raised dreq.
+void rx_adc_stream_iq_on_dreq(uint32_t rr_mask, uint dreq);
+
+// Reads the next I/Q capture of the inputs in rr_mask from the stream without deinterleaving it:
+// NUM_SAMPLES conversions for ADC_RR_MASK, NUM_DUAL_SAMPLES for ADC_DUAL_RR_MASK
+void rx_adc_capture_iq(uint32_t rr_mask, uint16_t *samples);
 
 // Take interleaved (round-robin samples and then separate into two separate arrays) I, Q samples
-// Specifically, takes NUM_SAMPLES total samples
-void take_interleaved_iq_samples(double *I_samples, double *Q_samples);
+// Specifically, takes the next NUM_SAMPLES total samples of the I/Q stream
+void take_interleaved_iq_samples(dsp_sample_t *I_samples, dsp_sample_t *Q_samples);
+
+// Removes bias from NUM_SAMPLES interleaved I, Q samples (e.g. a DMA capture) and separates them
+// into two arrays, as take_interleaved_iq_samples does after capturing
+void deinterleave_iq_samples(const uint16_t *samples, dsp_sample_t *I_samples, dsp_sample_t *Q_samples);
+
+// Takes incident and reflected I, Q samples in one round-robin capture of all four ADC inputs
+// (NUM_DUAL_SAMPLES conversions), deinterleaved into NUM_SAMPLES slots per array
+void take_dual_iq_samples(dsp_sample_t *ref_I, dsp_sample_t *ref_Q, dsp_sample_t *rfl_I, dsp_sample_t *rfl_Q);
+
+// Removes bias from NUM_DUAL_SAMPLES four-way interleaved samples and separates them into
+// incident and reflected I, Q arrays, as take_dual_iq_samples does after capturing
+void deinterleave_dual_iq_samples(const uint16_t *samples, dsp_sample_t *ref_I, dsp_sample_t *ref_Q,
+                                  dsp_sample_t *rfl_I, dsp_sample_t *rfl_Q);
+
+// Views of the I and Q inputs of a raw capture of NUM_SAMPLES interleaved I, Q samples, matching
+// deinterleave_iq_samples
+void iq_views(const uint16_t *samples, iq_view_t *I_view, iq_view_t *Q_view);
+
+// Views of the incident and reflected I and Q inputs of a raw capture of NUM_DUAL_SAMPLES
+// four-way interleaved samples, matching deinterleave_dual_iq_samples
+void dual_iq_views(const uint16_t *samples, iq_view_t *ref_I, iq_view_t *ref_Q, iq_view_t *rfl_I, iq_view_t *rfl_Q);
 
-// Measures a vector based on a pair of arrays of NUM_SAMPLES/2 samples of I and Q signals
-double_cplx_t calc_phasor(double *I_samples, double *Q_samples);
+// Takes the next block of the I/Q stream of the inputs in rr_mask (ADC_RR_MASK or
+// ADC_DUAL_RR_MASK) and measures the RMS level of each I/Q pair in it, in ADC counts
+// with the bias removed: levels[0] for ADC_I/ADC_Q, levels[1] for ADC_RFL_I/ADC_RFL_Q if captured
+void rx_adc_burst_levels(uint32_t rr_mask, double *levels);
+
+// Measures a vector (in ADC counts) based on a pair of arrays of NUM_SAMPLES/2 samples of I and Q signals
+double_cplx_t calc_phasor(dsp_sample_t *I_samples, dsp_sample_t *Q_samples);
+
+// As calc_phasor, reading I and Q through views of a raw capture
+double_cplx_t calc_phasor_view(const iq_view_t *I_view, const iq_view_t *Q_view);
+
+// Measures the phasor (in ADC counts) of the IF tone on I/Q pair `pair` (0 for ADC_I/ADC_Q, 1 for
+// ADC_RFL_I/ADC_RFL_Q) of an undeinterleaved capture of the inputs in rr_mask, by a single-bin DFT
+// at ADC_INPUT_FREQ over the processed region. Each conversion gets the twiddle for its own time,
+// so the skew between I and Q conversions cancels; the bias is removed exactly and the sums are integer.
+double_cplx_t calc_phasor_dft(const uint16_t *samples, uint32_t rr_mask, int pair);
+
+// RMS amplitude of the component at freq (cycles per sample) of num_samples samples, by the
+// Goertzel algorithm with integer state
+double goertzel_rms(const uint16_t *samples, int num_samples, double freq);
+
+// Selects the h[n] for a given center and width of bandpass filter (normalized to the sample rate)
+// as the filter kernel used by convolve, generating it unless it is cached
+void gen_fir_h(double center, double width);
+
+// Convolves NUM_SAMPLES samples with the current filter kernel into an internal buffer
+void convolve(const uint16_t *samples);
+
+// Convolves NUM_SAMPLES samples, less their mean, with the current filter kernel's integer taps,
+// computing only every decim'th output from FIR_VALID_FIRST up to FIR_VALID_END into out.
+// Returns the number of outputs.
+int convolve_valid(const uint16_t *samples, int decim, double *out);
 
 // Gets an RMS amplitude from a pin by sampling, filtering, and calculating RMS amplitude of the filtered signal
 double rx_adc_get_amplitude_blocking(int adc_pin, double freq);
 
+// Selects how rx_adc_get_amplitude_blocking filters (RX_AMPLITUDE_FIR by default)
+void rx_adc_set_amplitude_method(rx_amplitude_method_t method);
+
 // Does not apply any filtering, but takes the max - min of the signal
 double rx_adc_get_pp_unfiltered_blocking(int adc_pin);
 
@@ -0,0 +1,190 @@
+/* Module for continuous ADC capture into ping-ponged DMA buffers.
+*/
+
+#include "adc_stream.h"
+#include <string.h>
+#include <hardware/adc.h>
+#include <hardware/dma.h>
+#include <hardware/irq.h>
+#include <hardware/sync.h>
+
+// Block k of a stream lands in stream_buf[k % 2], written by dma_ch[k % 2]
+static uint16_t stream_buf[2][ADC_STREAM_MAX_BLOCK];
+static uint dma_ch[2];
+
+// Starts the ADC for adc_stream_start_on_dreq, by writing trigger_cs to its control register
+static uint trigger_ch;
+static uint32_t trigger_cs;
+
+// Current stream
+static bool streaming = false;
+static uint32_t stream_rr_mask;
+static uint stream_first_pin;
+static uint32_t block_len;
+
+static volatile uint32_t blocks_done;  // Completed since adc_stream_start
+static uint32_t blocks_read;            // Handed out by adc_stream_next_block
+static uint32_t overruns;
+
+static adc_stream_callback_t callback = NULL;
+static void *callback_ctx = NULL;
+
+// DMA completion: re-arms the channel that finished so the other one can chain back to it,
+// and publishes the block. The handler runs on the core that called adc_stream_init, which need not
+// be the one reading the stream, so it signals an event that wakes either core from __wfe().
+static void adc_stream_irq() {
+    int b = blocks_done % 2;
+    while(dma_channel_get_irq0_status(dma_ch[b])) {
+        dma_channel_acknowledge_irq0(dma_ch[b]);
+        dma_channel_set_write_addr(dma_ch[b], stream_buf[b], false);
+
+        uint32_t seq = blocks_done;
+        blocks_done = seq + 1;
+        if(callback) callback(stream_buf[b], seq, callback_ctx);
+        b = 1 - b;
+    }
+    __sev();
+}
+
+// Claims the DMA channels and installs the interrupt handler
+void adc_stream_init() {
+    dma_ch[0] = dma_claim_unused_channel(true);
+    dma_ch[1] = dma_claim_unused_channel(true);
+    trigger_ch = dma_claim_unused_channel(true);
+    irq_set_exclusive_handler(DMA_IRQ_0, adc_stream_irq);
+    irq_set_enabled(DMA_IRQ_0, true);
+}
+
+// Sets up streaming blocks of the inputs in rr_mask, short of starting the ADC
+static void adc_stream_arm(uint32_t rr_mask, uint first_pin, uint32_t len) {
+    adc_stream_stop();
+
+    stream_rr_mask = rr_mask;
+    stream_first_pin = first_pin;
+    block_len = len;
+    blocks_done = 0;
+    blocks_read = 0;
+
+    // Set up ADC for this sampling
+    adc_set_round_robin(rr_mask);
+    adc_select_input(first_pin - 26);
+    adc_fifo_setup(true, true, 1, false, false);
+    adc_set_clkdiv(0);  // Sample at full speed
+
+    // Each channel fills its own buffer then starts the other, reading from the constant FIFO
+    // address paced by ADC samples, as in
+    // https://github.com/raspberrypi/pico-examples/blob/master/adc/dma_capture/dma_capture.c
+    for(int b = 0; b < 2; b++) {
+        dma_channel_config cfg = dma_channel_get_default_config(dma_ch[b]);
+        channel_config_set_transfer_data_size(&cfg, DMA_SIZE_16);
+        channel_config_set_read_increment(&cfg, false);
+        channel_config_set_write_increment(&cfg, true);
+        channel_config_set_dreq(&cfg, DREQ_ADC);
+        channel_config_set_chain_to(&cfg, dma_ch[1 - b]);
+        dma_channel_configure(dma_ch[b], &cfg,
+            stream_buf[b],  // dst
+            &adc_hw->fifo,  // src
+            block_len,      // transfer count
+            b == 0          // start the first one immediately
+        );
+        dma_channel_acknowledge_irq0(dma_ch[b]);
+        dma_channel_set_irq0_enabled(dma_ch[b], true);
+    }
+
+    streaming = true;
+}
+
+// (Re)starts streaming blocks of the inputs in rr_mask
+void adc_stream_start(uint32_t rr_mask, uint first_pin, uint32_t len) {
+    adc_stream_arm(rr_mask, first_pin, len);
+    adc_run(true);
+}
+
+// (Re)starts streaming as adc_stream_start, from when dreq fires
+void adc_stream_start_on_dreq(uint32_t rr_mask, uint first_pin, uint32_t len, uint dreq) {
+    adc_stream_arm(rr_mask, first_pin, len);
+
+    // The control register as adc_run(true) would leave it, written by DMA when dreq fires
+    trigger_cs = adc_hw->cs | ADC_CS_START_MANY_BITS;
+    dma_channel_config cfg = dma_channel_get_default_config(trigger_ch);
+    channel_config_set_transfer_data_size(&cfg, DMA_SIZE_32);
+    channel_config_set_read_increment(&cfg, false);
+    channel_config_set_write_increment(&cfg, false);
+    channel_config_set_dreq(&cfg, dreq);
+    dma_channel_configure(trigger_ch, &cfg,
+        &adc_hw->cs,    // dst
+        &trigger_cs,    // src
+        1,              // transfer count
+        true            // start, to wait for dreq
+    );
+}
+
+// Stops the ADC and both DMA channels
+void adc_stream_stop() {
+    if(!streaming) return;
+
+    adc_run(false);
+    dma_channel_abort(trigger_ch);
+    for(int b = 0; b < 2; b++) {
+        dma_channel_set_irq0_enabled(dma_ch[b], false);
+        dma_channel_abort(dma_ch[b]);
+        dma_channel_acknowledge_irq0(dma_ch[b]);
+    }
+    adc_fifo_drain();
+    streaming = false;
+}
+
+// Starts streaming unless already streaming the same way
+void adc_stream_ensure(uint32_t rr_mask, uint first_pin, uint32_t len) {
+    if(streaming && rr_mask == stream_rr_mask && first_pin == stream_first_pin && len == block_len) return;
+    adc_stream_start(rr_mask, first_pin, len);
+}
+
+// Waits for the next block in sequence and returns it
+const uint16_t *adc_stream_next_block(uint32_t *seq) {
+    while(blocks_done == blocks_read) __wfe();
+
+    // Only the most recently completed block is safe from being overwritten
+    uint32_t done = blocks_done;
+    if(done - blocks_read > 1) {
+        overruns += done - blocks_read - 1;
+        blocks_read = done - 1;
+    }
+
+    if(seq) *seq = blocks_read;
+    return stream_buf[blocks_read++ % 2];
+}
+
+// Sequence number of the block adc_stream_next_block will return next
+uint32_t adc_stream_position() {
+    return blocks_read;
+}
+
+// Copies the next num_samples conversions into dst, contiguous in time
+void adc_stream_read(uint16_t *dst, uint32_t num_samples) {
+    uint32_t copied = 0;
+    uint32_t last_seq = 0;
+    while(copied < num_samples) {
+        uint32_t seq;
+        const uint16_t *block = adc_stream_next_block(&seq);
+        if(copied > 0 && seq != last_seq + 1) copied = 0;  // Missed a block, start over
+
+        uint32_t n = num_samples - copied < block_len ? num_samples - copied : block_len;
+        memcpy(dst + copied, block, n * sizeof(uint16_t));
+        copied += n;
+        last_seq = seq;
+    }
+}
+
+// Sets a callback for completed blocks
+void adc_stream_set_callback(adc_stream_callback_t cb, void *ctx) {
+    uint32_t int_sav = save_and_disable_interrupts();
+    callback = cb;
+    callback_ctx = ctx;
+    restore_interrupts(int_sav);
+}
+
+// Blocks skipped by adc_stream_next_block
+uint32_t adc_stream_overruns() {
+    return overruns;
+}
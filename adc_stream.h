@@ -0,0 +1,59 @@
+/* Module for continuous ADC capture.
+   Two DMA channels, chained to each other, ping-pong between two buffers so the ADC
+   never stops between blocks: while the CPU works on block N, block N+1 is landing.
+   Completed blocks are handed out in order through a one-deep queue (adc_stream_next_block)
+   and/or a callback run from the DMA interrupt.
+*/
+
+#ifndef ADC_STREAM_H
+#define ADC_STREAM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <pico.h>
+#include "adc_sampling.h"
+
+// Largest block, in conversions (a whole dual capture)
+#define ADC_STREAM_MAX_BLOCK NUM_DUAL_SAMPLES
+
+// Called from the DMA interrupt for each completed block; the block is only valid until the next
+// one completes
+typedef void (*adc_stream_callback_t)(const uint16_t *block, uint32_t seq, void *ctx);
+
+// Claims the DMA channels and installs the interrupt handler. Called once, by rx_adc_init.
+void adc_stream_init();
+
+// (Re)starts streaming blocks of block_len conversions of the inputs in rr_mask (0 for just
+// first_pin), beginning with the input on GPIO first_pin. Block 0 starts with the first conversion.
+void adc_stream_start(uint32_t rr_mask, uint first_pin, uint32_t block_len);
+
+// (Re)starts streaming as adc_stream_start, but leaves the ADC stopped until dreq fires; a DMA
+// channel paced by dreq then starts it, so the first conversion is timed by whatever raises dreq
+// (e.g. a PIO state machine pushing to its RX FIFO) rather than by the CPU
+void adc_stream_start_on_dreq(uint32_t rr_mask, uint first_pin, uint32_t block_len, uint dreq);
+
+// Starts streaming as adc_stream_start, unless already streaming the same way
+void adc_stream_ensure(uint32_t rr_mask, uint first_pin, uint32_t block_len);
+
+// Stops the ADC and both DMA channels
+void adc_stream_stop();
+
+// Waits for the next block in sequence and returns it, valid until the block after it completes.
+// If the caller fell behind and blocks were overwritten, skips to the oldest one still intact.
+const uint16_t *adc_stream_next_block(uint32_t *seq);
+
+// Sequence number of the block adc_stream_next_block will return next (blocks are back-to-back,
+// so this also counts block durations since the stream started)
+uint32_t adc_stream_position();
+
+// Copies the next num_samples conversions into dst, contiguous in time; restarts the copy if a
+// block is missed along the way
+void adc_stream_read(uint16_t *dst, uint32_t num_samples);
+
+// Sets a callback for completed blocks (NULL for none)
+void adc_stream_set_callback(adc_stream_callback_t callback, void *ctx);
+
+// Blocks skipped by adc_stream_next_block since adc_stream_init
+uint32_t adc_stream_overruns();
+
+#endif
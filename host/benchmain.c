@@ -0,0 +1,52 @@
+// Host runner for the kernel benchmarks in vnabench.c
+// Prints CSV (see vna_bench_run) so results can be diffed between builds.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "vnabench.h"
+#include "sim.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+static uint64_t host_time_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+// Time-stamp counter; counts at the nominal (not boosted) core clock
+static uint64_t host_cycles() {
+  return __rdtsc();
+}
+#endif
+
+int main(int argc, char **argv) {
+  uint32_t iterations = 10000;
+
+  for(int i = 1; i < argc; i++) {
+    if(!strcmp(argv[i], "-i") && i + 1 < argc) iterations = strtoul(argv[++i], NULL, 10);
+    else {
+      printf("Usage: %s [-i iterations]\n", argv[0]);
+      return 2;
+    }
+  }
+
+  vna_bench_timer_t timer = {
+    host_time_ns,
+#if defined(__x86_64__) || defined(__i386__)
+    host_cycles,
+#else
+    NULL,
+#endif
+    0.0
+  };
+
+  sim_init(NULL);
+  vna_bench_run("host", &timer, iterations);
+  return 0;
+}
@@ -0,0 +1,460 @@
+// Accuracy checks of the per-sample DSP, built once per DSP_NUMERIC type (SuperVNA_dspcheck_<type>).
+// Synthesizes round-robin I/Q captures over a grid of reference levels, |Gamma| and phases and
+//  - runs them through deinterleave_iq_samples + vna_calc_gamma_raw as built, comparing with the
+//    same algorithm in double
+//  - checks that the cross-spectrum estimator agrees with the per-sample one on ideal I/Q samples,
+//    and that both stay within the I/Q skew bound on round-robin captures
+//  - checks calc_phasor_dft against the synthesized tone, and that the DFT estimator is no less
+//    accurate than the cross-spectrum on round-robin captures
+//  - checks the RMS from convolve_valid, at full rate and decimated, against a double FIR
+//  - checks that gamma from views of the raw captures is identical to gamma from the
+//    deinterleaved arrays, for switched and dual captures
+//  - checks the cal kit model against closed forms, and the batched cal kernels (vna_cal_points,
+//    vna_cal_points_stds) against vna_cal_point, with ideal and modelled standards, and that both
+//    recover the error terms the standards were measured through
+
+#include <stdio.h>
+#include <math.h>
+#include "vna.h"
+#include "sim.h"
+
+// Stated bound versus the double reference: |Gamma - Gamma_ref| must be no more than an error
+// of MAX_REF_ERROR ADC counts on the reference phasor, i.e. |dGamma| <= MAX_REF_ERROR/ref_counts.
+// That is well under the ~1 count noise of a real capture. The matching phase bound is
+// asin(MAX_REF_ERROR/(ref_counts*|Gamma|)).
+#define MAX_REF_ERROR 0.03
+
+static const double ref_levels[] = {1500, 600, 150, 50, 15};   // ADC counts
+static const double gamma_mags[] = {1.0, 0.5, 0.1, 0.03};
+static const double if_phases[] = {0.0, 1.1, 2.3};         // Radians at the start of a capture
+
+static uint32_t lcg = 1;
+
+// Allowed disagreement between the estimators on ideal samples, in the same units: both see the
+// same noise but weight it differently, so they differ by a fraction of the noise-driven error
+#define MAX_ESTIMATOR_DIFF 0.5
+#define MIN_EST_REF_COUNTS 50
+
+// Largest |phasor - actual| from calc_phasor_dft, in ADC counts: the DFT averages the 1 count
+// noise over NUM_SAMPLES_PROCESSED conversions, so this is several sigma
+#define MAX_PHASOR_ERROR 1.0
+
+// Largest relative error in the filtered RMS from convolve_valid's Q12 taps and decimation
+#define MAX_FIR_RMS_ERROR 0.002
+
+// Cal check: points of random error terms, and the largest difference in any term between
+// vna_cal_points and vna_cal_point (rounding only), and between either and the actual terms
+#define CAL_CHECK_POINTS 500
+#define MAX_CAL_BATCH_DIFF 1e-12
+#define MAX_CAL_TERM_ERROR 1e-9
+
+// Roughly normal noise with 1 count rms
+static double noise() {
+  double sum = 0.0;
+  for(int i = 0; i < 4; i++) {
+    lcg = lcg * 1664525 + 1013904223;
+    sum += (lcg >> 8) / 16777216.0 - 0.5;
+  }
+  return sum * sqrt(3.0);
+}
+
+// Uniform in [-0.5, 0.5)
+static double uniform() {
+  lcg = lcg * 1664525 + 1013904223;
+  return (lcg >> 8) / 16777216.0 - 0.5;
+}
+
+// Raw gamma of a standard of actual gamma g through error terms e
+static double_cplx_t measure_standard(double_cplx_t g, error_terms_t e) {
+  double_cplx_t num = cplx_sub(e.e0, cplx_mult(e.De, g));
+  double_cplx_t den = cplx_sub(cplx_unity, cplx_mult(e.e1, g));
+  return cplx_div(num, den);
+}
+
+// Largest |difference| over the three terms
+static double terms_diff(error_terms_t x, error_terms_t y) {
+  double_cplx_t d0 = cplx_sub(x.e0, y.e0), d1 = cplx_sub(x.e1, y.e1), dd = cplx_sub(x.De, y.De);
+  return fmax(cplx_mag(d0), fmax(cplx_mag(d1), cplx_mag(dd)));
+}
+
+// Round-robin I/Q capture of the IF tone
+static void gen_capture(uint16_t *buf, double amplitude, double phase) {
+  for(int i = 0; i < NUM_SAMPLES; i++) {
+    double theta = 2.0*MATH_PI*ADC_INPUT_FREQ*i/ADC_TOTAL_SAMPLE_RATE + phase;
+    double v = (i % 2 == 0) ? cos(theta) : sin(theta);
+    long code = lround(2048.0 + amplitude*v + noise());
+    buf[i] = code < 0 ? 0 : (code > 4095 ? 4095 : code);
+  }
+}
+
+// Ideal I/Q samples of the IF tone, with I and Q of each pair taken at the same instant
+static void gen_ideal_iq(dsp_sample_t *I_samples, dsp_sample_t *Q_samples, double amplitude, double phase) {
+  for(int i = 0; i < NUM_SAMPLES; i++) {
+    double theta = 2.0*MATH_PI*ADC_INPUT_FREQ*i/ADC_TOTAL_SAMPLE_RATE + phase;
+    I_samples[i] = dsp_from_adc(lround(amplitude*cos(theta) + noise()), 0);
+    Q_samples[i] = dsp_from_adc(lround(amplitude*sin(theta) + noise()), 0);
+  }
+}
+
+// Single-input capture of a tone at freq (cycles per conversion)
+static void gen_single_capture(uint16_t *buf, double amplitude, double freq, double phase) {
+  for(int i = 0; i < NUM_SAMPLES; i++) {
+    long code = lround(2048.0 + amplitude*cos(2.0*MATH_PI*freq*i + phase) + noise());
+    buf[i] = code < 0 ? 0 : (code > 4095 ? 4095 : code);
+  }
+}
+
+// Double reference of the filtered RMS in rx_adc_get_amplitude_blocking: the mean-removed capture
+// through gen_fir_h's kernel, over every output from FIR_VALID_FIRST to FIR_VALID_END
+static double ref_fir_rms(const uint16_t *samples, double center, double width) {
+  double mean = 0.0;
+  for(int i = 0; i < NUM_SAMPLES; i++) mean += samples[i];
+  mean /= NUM_SAMPLES;
+
+  double sumsq = 0.0;
+  for(int n = FIR_VALID_FIRST; n < FIR_VALID_END; n++) {
+    double y = 0.0;
+    for(int k = 0; k < FIR_N; k++) {
+      int m = k - FIR_N/2;
+      double x = 2.0*MATH_PI*width*m;
+      double sinc = m == 0 ? 1.0 : sin(x)/x;
+      y += (samples[n - k] - mean) * 2.0*MATH_PI*width*sinc*cos(2.0*MATH_PI*center*m);
+    }
+    sumsq += y*y;
+  }
+  return sqrt(sumsq / (FIR_VALID_END - FIR_VALID_FIRST));
+}
+
+// RMS of the filtered tone itself, amplitude*|H(center)|/sqrt(2)
+static double tone_fir_rms(double amplitude, double center, double width) {
+  double_cplx_t H = cplx_zero;
+  for(int k = 0; k < FIR_N; k++) {
+    int m = k - FIR_N/2;
+    double x = 2.0*MATH_PI*width*m;
+    double h = 2.0*MATH_PI*width * (m == 0 ? 1.0 : sin(x)/x) * cos(2.0*MATH_PI*center*m);
+    double_cplx_t term = {h*cos(2.0*MATH_PI*center*k), -h*sin(2.0*MATH_PI*center*k)};
+    H = cplx_add(H, term);
+  }
+  return amplitude * cplx_mag(H) / sqrt(2.0);
+}
+
+// RMS of convolve_valid's outputs
+static double fir_rms(const uint16_t *samples, int decim) {
+  static double y[NUM_SAMPLES];
+  int num_out = convolve_valid(samples, decim, y);
+  double sumsq = 0.0;
+  for(int i = 0; i < num_out; i++) sumsq += y[i]*y[i];
+  return sqrt(sumsq / num_out);
+}
+
+// Double reference of deinterleave_iq_samples
+static void ref_deinterleave(const uint16_t *samples, double *I_samples, double *Q_samples) {
+  double i_bias = 0.0, q_bias = 0.0;
+  int num_i = 0, num_q = 0;
+  for(int i = NUM_SAMPLES - NUM_SAMPLES_PROCESSED; i < NUM_SAMPLES; i += 2) {
+    i_bias += samples[i];
+    num_i++;
+  }
+  for(int i = NUM_SAMPLES - NUM_SAMPLES_PROCESSED + 1; i < NUM_SAMPLES; i += 2) {
+    q_bias += samples[i];
+    num_q++;
+  }
+  i_bias /= num_i;
+  q_bias /= num_q;
+
+  for(int i = 0; i < NUM_SAMPLES - 1; i++) {
+    if(i % 2 == 0) I_samples[i] = I_samples[i+1] = samples[i] - i_bias;
+    else Q_samples[i] = Q_samples[i+1] = samples[i] - q_bias;
+  }
+  Q_samples[NUM_SAMPLES-1] = samples[NUM_SAMPLES-1] - q_bias;
+}
+
+// Double reference of vna_calc_gamma_raw
+static double_cplx_t ref_gamma(double *ref_I, double *ref_Q, double *rfl_I, double *rfl_Q) {
+  double_cplx_t total = cplx_zero;
+  for(int i = NUM_SAMPLES - NUM_SAMPLES_PROCESSED; i < NUM_SAMPLES; i++) {
+    double_cplx_t ref = {ref_I[i], ref_Q[i]};
+    double_cplx_t rfl = {rfl_I[i], rfl_Q[i]};
+    total = cplx_add(total, cplx_div(rfl, ref));
+  }
+  return cplx_scale(total, 1.0/NUM_SAMPLES_PROCESSED);
+}
+
+int main() {
+  static uint16_t ref_buf[NUM_SAMPLES], rfl_buf[NUM_SAMPLES];
+  static dsp_sample_t ref_I[NUM_SAMPLES], ref_Q[NUM_SAMPLES], rfl_I[NUM_SAMPLES], rfl_Q[NUM_SAMPLES];
+  static double dref_I[NUM_SAMPLES], dref_Q[NUM_SAMPLES], drfl_I[NUM_SAMPLES], drfl_Q[NUM_SAMPLES];
+  bool pass = true;
+
+  vna_set_gamma_estimator(VNA_GAMMA_PER_SAMPLE);
+  printf("DSP type: %s\n", DSP_NUMERIC_NAME);
+  printf("ref counts  |Γ|     max |ΔΓ|    max |ΔΓ|*ref   max phase err (deg)   bound (deg)\n");
+
+  for(int r = 0; r < sizeof(ref_levels)/sizeof(ref_levels[0]); r++) {
+    for(int m = 0; m < sizeof(gamma_mags)/sizeof(gamma_mags[0]); m++) {
+      double max_err = 0.0, max_phase_err = 0.0;
+
+      for(int p = 0; p < sizeof(if_phases)/sizeof(if_phases[0]); p++) {
+        for(int a = 0; a < 360; a += 15) {
+          double angle = a * MATH_PI / 180.0;
+          gen_capture(ref_buf, ref_levels[r], if_phases[p]);
+          gen_capture(rfl_buf, ref_levels[r] * gamma_mags[m], if_phases[p] + angle);
+
+          deinterleave_iq_samples(ref_buf, ref_I, ref_Q);
+          deinterleave_iq_samples(rfl_buf, rfl_I, rfl_Q);
+          double_cplx_t g = vna_calc_gamma_raw(ref_I, ref_Q, rfl_I, rfl_Q);
+
+          ref_deinterleave(ref_buf, dref_I, dref_Q);
+          ref_deinterleave(rfl_buf, drfl_I, drfl_Q);
+          double_cplx_t g_ref = ref_gamma(dref_I, dref_Q, drfl_I, drfl_Q);
+
+          double err = cplx_mag(cplx_sub(g, g_ref));
+          double phase_err = fabs(remainder(cplx_ang_deg(g) - cplx_ang_deg(g_ref), 360.0));
+          if(err > max_err) max_err = err;
+          if(phase_err > max_phase_err) max_phase_err = phase_err;
+        }
+      }
+
+      double max_phase = asin(fmin(1.0, MAX_REF_ERROR / (ref_levels[r] * gamma_mags[m]))) * 180.0 / MATH_PI;
+      if(max_err * ref_levels[r] > MAX_REF_ERROR || max_phase_err > max_phase) pass = false;
+      printf("%10.0f  %5.2f   %10.2e   %12.4f   %19.2e   %11.2e\n", ref_levels[r], gamma_mags[m],
+        max_err, max_err * ref_levels[r], max_phase_err, max_phase);
+    }
+  }
+
+  printf("Bound |ΔΓ| <= %g counts / ref counts: %s\n\n", MAX_REF_ERROR, pass ? "PASS" : "FAIL");
+
+  // Cross-spectrum vs per-sample estimator on ideal (simultaneous) I/Q samples, where both are
+  // unbiased and should agree to within the noise
+  bool pass_est = true;
+  printf("Estimators on ideal I/Q samples: |Γxspec - Γpersample|*ref counts\n");
+  printf("ref counts  |Γ|     xspec-persample\n");
+  for(int r = 0; r < sizeof(ref_levels)/sizeof(ref_levels[0]); r++) {
+    for(int m = 0; m < sizeof(gamma_mags)/sizeof(gamma_mags[0]); m++) {
+      double max_diff = 0.0;
+
+      for(int p = 0; p < sizeof(if_phases)/sizeof(if_phases[0]); p++) {
+        for(int a = 0; a < 360; a += 15) {
+          double angle = a * MATH_PI / 180.0;
+          gen_ideal_iq(ref_I, ref_Q, ref_levels[r], if_phases[p]);
+          gen_ideal_iq(rfl_I, rfl_Q, ref_levels[r] * gamma_mags[m], if_phases[p] + angle);
+
+          vna_set_gamma_estimator(VNA_GAMMA_PER_SAMPLE);
+          double_cplx_t g_per = vna_calc_gamma_raw(ref_I, ref_Q, rfl_I, rfl_Q);
+          vna_set_gamma_estimator(VNA_GAMMA_CROSS_SPECTRUM);
+          double_cplx_t g_xspec = vna_calc_gamma_raw(ref_I, ref_Q, rfl_I, rfl_Q);
+
+          max_diff = fmax(max_diff, cplx_mag(cplx_sub(g_xspec, g_per)) * ref_levels[r]);
+        }
+      }
+
+      if(ref_levels[r] >= MIN_EST_REF_COUNTS && max_diff > MAX_ESTIMATOR_DIFF) pass_est = false;
+      printf("%10.0f  %5.2f   %15.4f\n", ref_levels[r], gamma_mags[m], max_diff);
+    }
+  }
+  printf("Bound |Γxspec - Γpersample| <= %g counts / ref counts (ref >= %d counts): %s\n\n",
+    MAX_ESTIMATOR_DIFF, MIN_EST_REF_COUNTS, pass_est ? "PASS" : "FAIL");
+
+  // On round-robin captures, I and Q of each pair are taken one conversion apart, which
+  // neither estimator corrects. The skew leaves an image of each phasor tan(skew/2) of its size,
+  // with conjugate phase, so the relative error in Gamma is at most 2*sin^2(skew/2). Check both
+  // estimators against that, give or take one count of noise on the reflected phasor.
+  double skew_bound = 2.0 * pow(sin(MATH_PI / IF_PERIOD_CONVERSIONS), 2);
+  printf("Estimators on round-robin captures: max |ΔΓ| from actual Γ, relative to |Γ|\n");
+  printf("ref counts  |Γ|     persample   xspec\n");
+  for(int r = 0; r < sizeof(ref_levels)/sizeof(ref_levels[0]); r++) {
+    for(int m = 0; m < sizeof(gamma_mags)/sizeof(gamma_mags[0]); m++) {
+      double max_per_err = 0.0, max_xspec_err = 0.0;
+
+      for(int p = 0; p < sizeof(if_phases)/sizeof(if_phases[0]); p++) {
+        for(int a = 0; a < 360; a += 15) {
+          double angle = a * MATH_PI / 180.0;
+          double_cplx_t actual = {gamma_mags[m] * cos(angle), gamma_mags[m] * sin(angle)};
+          gen_capture(ref_buf, ref_levels[r], if_phases[p]);
+          gen_capture(rfl_buf, ref_levels[r] * gamma_mags[m], if_phases[p] + angle);
+          deinterleave_iq_samples(ref_buf, ref_I, ref_Q);
+          deinterleave_iq_samples(rfl_buf, rfl_I, rfl_Q);
+
+          vna_set_gamma_estimator(VNA_GAMMA_PER_SAMPLE);
+          double_cplx_t g_per = vna_calc_gamma_raw(ref_I, ref_Q, rfl_I, rfl_Q);
+          vna_set_gamma_estimator(VNA_GAMMA_CROSS_SPECTRUM);
+          double_cplx_t g_xspec = vna_calc_gamma_raw(ref_I, ref_Q, rfl_I, rfl_Q);
+
+          max_per_err = fmax(max_per_err, cplx_mag(cplx_sub(g_per, actual)) / gamma_mags[m]);
+          max_xspec_err = fmax(max_xspec_err, cplx_mag(cplx_sub(g_xspec, actual)) / gamma_mags[m]);
+        }
+      }
+
+      double noise_allowance = 1.0 / (ref_levels[r] * gamma_mags[m]);
+      if(fmax(max_per_err, max_xspec_err) > skew_bound + noise_allowance) pass_est = false;
+      printf("%10.0f  %5.2f   %9.4f   %5.4f\n", ref_levels[r], gamma_mags[m], max_per_err, max_xspec_err);
+    }
+  }
+  printf("Both within the I/Q skew bound %.4f, +-1 count: %s\n\n", skew_bound, pass_est ? "PASS" : "FAIL");
+
+  // Single-bin DFT on the raw captures: each conversion is weighted at its own time, so the I/Q
+  // skew that the other estimators leave is gone
+  bool pass_dft = true;
+  double max_phasor_err = 0.0;
+  printf("DFT estimator on round-robin captures: max |ΔΓ| from actual Γ, relative to |Γ|\n");
+  printf("ref counts  |Γ|     xspec    dft\n");
+  for(int r = 0; r < sizeof(ref_levels)/sizeof(ref_levels[0]); r++) {
+    for(int m = 0; m < sizeof(gamma_mags)/sizeof(gamma_mags[0]); m++) {
+      double max_xspec_err = 0.0, max_dft_err = 0.0;
+
+      for(int p = 0; p < sizeof(if_phases)/sizeof(if_phases[0]); p++) {
+        for(int a = 0; a < 360; a += 15) {
+          double angle = a * MATH_PI / 180.0;
+          double_cplx_t actual = {gamma_mags[m] * cos(angle), gamma_mags[m] * sin(angle)};
+          gen_capture(ref_buf, ref_levels[r], if_phases[p]);
+          gen_capture(rfl_buf, ref_levels[r] * gamma_mags[m], if_phases[p] + angle);
+
+          double_cplx_t phasor = calc_phasor_dft(ref_buf, ADC_RR_MASK, 0);
+          double_cplx_t phasor_actual = {ref_levels[r] * cos(if_phases[p]), ref_levels[r] * sin(if_phases[p])};
+          max_phasor_err = fmax(max_phasor_err, cplx_mag(cplx_sub(phasor, phasor_actual)));
+
+          vna_set_gamma_estimator(VNA_GAMMA_CROSS_SPECTRUM);
+          double_cplx_t g_xspec = vna_calc_gamma_raw_capture(ref_buf, rfl_buf, ADC_RR_MASK);
+          vna_set_gamma_estimator(VNA_GAMMA_DFT);
+          double_cplx_t g_dft = vna_calc_gamma_raw_capture(ref_buf, rfl_buf, ADC_RR_MASK);
+
+          max_xspec_err = fmax(max_xspec_err, cplx_mag(cplx_sub(g_xspec, actual)) / gamma_mags[m]);
+          max_dft_err = fmax(max_dft_err, cplx_mag(cplx_sub(g_dft, actual)) / gamma_mags[m]);
+        }
+      }
+
+      double noise_allowance = 1.0 / (ref_levels[r] * gamma_mags[m]);
+      if(max_dft_err > max_xspec_err + noise_allowance) pass_dft = false;
+      printf("%10.0f  %5.2f   %6.4f   %6.4f\n", ref_levels[r], gamma_mags[m], max_xspec_err, max_dft_err);
+    }
+  }
+  if(max_phasor_err > MAX_PHASOR_ERROR) pass_dft = false;
+  printf("Max |phasor error| %.3f counts (bound %g)\n", max_phasor_err, MAX_PHASOR_ERROR);
+  printf("DFT no worse than cross-spectrum, +-1 count: %s\n\n", pass_dft ? "PASS" : "FAIL");
+
+  // Valid-region integer FIR, at full rate and decimated at the IF
+  bool pass_fir = true;
+  // At full rate the valid region is not a whole number of IF periods, so it is compared with
+  // the same region through a double FIR; decimated, it is, so it is compared with the tone's RMS
+  printf("convolve_valid at the IF: relative RMS error (full rate vs double FIR, decimated vs tone)\n");
+  printf("amplitude   full rate   decimated\n");
+  gen_fir_h(FIR_IF_CENTER, FIR_IF_WIDTH);
+  for(int r = 0; r < sizeof(ref_levels)/sizeof(ref_levels[0]); r++) {
+    double max_full_err = 0.0, max_decim_err = 0.0;
+    for(int p = 0; p < sizeof(if_phases)/sizeof(if_phases[0]); p++) {
+      gen_single_capture(ref_buf, ref_levels[r], FIR_IF_CENTER, if_phases[p]);
+      double rms_ref = ref_fir_rms(ref_buf, FIR_IF_CENTER, FIR_IF_WIDTH);
+      max_full_err = fmax(max_full_err, fabs(fir_rms(ref_buf, 1) / rms_ref - 1.0));
+      double rms_tone = tone_fir_rms(ref_levels[r], FIR_IF_CENTER, FIR_IF_WIDTH);
+      max_decim_err = fmax(max_decim_err, fabs(fir_rms(ref_buf, FIR_IF_DECIMATION) / rms_tone - 1.0));
+    }
+    if(ref_levels[r] >= MIN_EST_REF_COUNTS && fmax(max_full_err, max_decim_err) > MAX_FIR_RMS_ERROR) pass_fir = false;
+    printf("%9.0f   %9.5f   %9.5f\n", ref_levels[r], max_full_err, max_decim_err);
+  }
+  printf("Bound %g relative (amplitude >= %d counts): %s\n", MAX_FIR_RMS_ERROR, MIN_EST_REF_COUNTS,
+    pass_fir ? "PASS" : "FAIL");
+
+  // Zero-copy views read exactly the samples the deinterleaved arrays hold, so the results must
+  // be identical
+  static uint16_t dual_buf[NUM_DUAL_SAMPLES];
+  static const vna_gamma_estimator_t view_estimators[] = {VNA_GAMMA_PER_SAMPLE, VNA_GAMMA_CROSS_SPECTRUM};
+  int view_mismatches = 0, view_cases = 0;
+  for(int e = 0; e < 2; e++) {
+    vna_set_gamma_estimator(view_estimators[e]);
+    for(int r = 0; r < sizeof(ref_levels)/sizeof(ref_levels[0]); r++) {
+      for(int a = 0; a < 360; a += 15) {
+        double angle = a * MATH_PI / 180.0;
+        gen_capture(ref_buf, ref_levels[r], if_phases[a % 3]);
+        gen_capture(rfl_buf, ref_levels[r] * gamma_mags[a % 4], if_phases[a % 3] + angle);
+
+        deinterleave_iq_samples(ref_buf, ref_I, ref_Q);
+        deinterleave_iq_samples(rfl_buf, rfl_I, rfl_Q);
+        double_cplx_t g = vna_calc_gamma_raw(ref_I, ref_Q, rfl_I, rfl_Q);
+        double_cplx_t g_view = vna_calc_gamma_raw_capture(ref_buf, rfl_buf, ADC_RR_MASK);
+        if(g.a != g_view.a || g.b != g_view.b) view_mismatches++;
+
+        for(int i = 0; i < NUM_SAMPLES; i++) {
+          dual_buf[2*i - (i % 2)] = ref_buf[i];       // Slot 4j + c for I/Q sample c of pair j
+          dual_buf[2*i - (i % 2) + 2] = rfl_buf[i];
+        }
+        deinterleave_dual_iq_samples(dual_buf, ref_I, ref_Q, rfl_I, rfl_Q);
+        g = vna_calc_gamma_raw(ref_I, ref_Q, rfl_I, rfl_Q);
+        g_view = vna_calc_gamma_raw_capture(dual_buf, NULL, ADC_DUAL_RR_MASK);
+        if(g.a != g_view.a || g.b != g_view.b) view_mismatches++;
+        view_cases += 2;
+      }
+    }
+  }
+  bool pass_view = view_mismatches == 0;
+  printf("\nGamma from raw capture views vs deinterleaved arrays: %d of %d differ: %s\n",
+    view_mismatches, view_cases, pass_view ? "PASS" : "FAIL");
+
+  // Cal kit model: an ideal kit gives the ideal standards, a lossless offset short is -1 delayed
+  // by the round trip, and an open with no offset has the phase of its capacitance
+  static const vna_cal_kit_t ideal_kit = {{0.0, 0.0, 50.0}, 0, 0, 0, 0, {0.0, 0.0, 50.0}, 0, 0, 0, 0, {0.0, 0.0, 50.0}, 50.0};
+  static const vna_cal_kit_t delay_kit = {{100.0, 0.0, 50.0}, 0, 0, 0, 0, {0.0, 0.0, 50.0}, 80.0, 0, 0, 0, {0.0, 0.0, 50.0}, 50.0};
+  double max_model_err = 0.0;
+  for(double f = 1000.0; f <= 3e6; f *= 3.0) {
+    vna_cal_standards_t ideal = vna_cal_kit_standards(&ideal_kit, f);
+    vna_cal_standards_t delayed = vna_cal_kit_standards(&delay_kit, f);
+    double w = 2.0*MATH_PI*f*1e3;
+    double_cplx_t short_expect = {-cos(2.0*w*100e-12), sin(2.0*w*100e-12)};
+    double open_phase = -2.0*atan(w*80e-15*VNA_CAL_Z0);
+    double_cplx_t open_expect = {cos(open_phase), sin(open_phase)};
+    max_model_err = fmax(max_model_err, fmax(terms_diff(
+      (error_terms_t) {ideal.g_short, ideal.g_open, ideal.g_load},
+      (error_terms_t) {Gamma_Short, Gamma_Open, Gamma_Load}), terms_diff(
+      (error_terms_t) {delayed.g_short, delayed.g_open, delayed.g_load},
+      (error_terms_t) {short_expect, open_expect, Gamma_Load})));
+  }
+  bool pass_cal = max_model_err <= MAX_CAL_BATCH_DIFF;
+  printf("\nvna_cal_kit_standards vs closed forms: max difference %.3g (bound %g): %s\n",
+    max_model_err, MAX_CAL_BATCH_DIFF, max_model_err <= MAX_CAL_BATCH_DIFF ? "PASS" : "FAIL");
+
+  // Batched cal math against the per-point reference, over bridges with random error terms:
+  // directivity e00 and source match e11 up to 0.5, tracking e10*e01 around 1. First with ideal
+  // standards, then per point with check_kit's from 1MHz to 3GHz, where they are far from ideal.
+  static const vna_cal_kit_t check_kit = {
+    {31.8, 2.36, 50.0}, 2.08, -108.5, 2.17, -0.01,
+    {29.2, 2.2, 50.0}, 49.4, -310.1, 23.2, -0.16,
+    {10.0, 2.0, 50.0}, 55.0
+  };
+  static double_cplx_t m_short[CAL_CHECK_POINTS], m_open[CAL_CHECK_POINTS], m_load[CAL_CHECK_POINTS];
+  static vna_cal_standards_t stds[CAL_CHECK_POINTS];
+  static error_terms_t actual_terms[CAL_CHECK_POINTS], batch_terms[CAL_CHECK_POINTS];
+  for(int kit = 0; kit < 2; kit++) {
+    for(int i = 0; i < CAL_CHECK_POINTS; i++) {
+      double_cplx_t e0 = {uniform(), uniform()};
+      double_cplx_t e1 = {uniform(), uniform()};
+      double_cplx_t tracking = {1.0 + 0.5*uniform(), 0.5*uniform()};
+      actual_terms[i] = (error_terms_t) {e0, e1, cplx_sub(cplx_mult(e0, e1), tracking)};
+      stds[i] = kit ? vna_cal_kit_standards(&check_kit, 1000.0 * pow(3000.0, (double) i / CAL_CHECK_POINTS))
+                    : VNA_CAL_STANDARDS_IDEAL;
+      m_short[i] = measure_standard(stds[i].g_short, actual_terms[i]);
+      m_open[i] = measure_standard(stds[i].g_open, actual_terms[i]);
+      m_load[i] = measure_standard(stds[i].g_load, actual_terms[i]);
+    }
+    if(kit) {
+      vna_cal_points_stds(stds, m_short, m_open, m_load, batch_terms, CAL_CHECK_POINTS);
+    } else {
+      vna_cal_coeffs_t coeffs = vna_cal_coeffs(VNA_CAL_STANDARDS_IDEAL);
+      vna_cal_points(&coeffs, m_short, m_open, m_load, batch_terms, CAL_CHECK_POINTS);
+    }
+
+    double max_batch_diff = 0.0, max_term_err = 0.0;
+    for(int i = 0; i < CAL_CHECK_POINTS; i++) {
+      error_terms_t ref_terms = vna_cal_point(m_short[i], m_open[i], m_load[i], stds[i]);
+      max_batch_diff = fmax(max_batch_diff, terms_diff(batch_terms[i], ref_terms));
+      max_term_err = fmax(max_term_err, fmax(terms_diff(batch_terms[i], actual_terms[i]),
+                                             terms_diff(ref_terms, actual_terms[i])));
+    }
+    bool pass_kit = max_batch_diff <= MAX_CAL_BATCH_DIFF && max_term_err <= MAX_CAL_TERM_ERROR;
+    if(!pass_kit) pass_cal = false;
+    printf("%s vs vna_cal_point over %d points, %s standards: max term difference %.3g (bound %g), "
+      "max error vs actual terms %.3g (bound %g): %s\n", kit ? "vna_cal_points_stds" : "vna_cal_points",
+      CAL_CHECK_POINTS, kit ? "kit" : "ideal", max_batch_diff, MAX_CAL_BATCH_DIFF,
+      max_term_err, MAX_CAL_TERM_ERROR, pass_kit ? "PASS" : "FAIL");
+  }
+
+  return pass && pass_est && pass_dft && pass_fir && pass_view && pass_cal ? 0 : 1;
+}
@@ -0,0 +1,36 @@
+// Host stand-in for <hardware/adc.h>
+// Conversions are produced by the synthetic Tayloe model when DMA drains the FIFO.
+
+#ifndef _HARDWARE_ADC_H
+#define _HARDWARE_ADC_H
+
+#include "pico.h"
+
+typedef struct {
+    io_rw_32 cs;
+    io_ro_32 result;
+    io_rw_32 fcs;
+    io_ro_32 fifo;
+    io_rw_32 div;
+    io_ro_32 intr;
+    io_rw_32 inte;
+    io_rw_32 intf;
+    io_ro_32 ints;
+} adc_hw_t;
+
+#define ADC_CS_START_MANY_BITS 0x00000008
+
+extern adc_hw_t sim_adc_regs;
+#define adc_hw (&sim_adc_regs)
+
+void adc_init(void);
+void adc_gpio_init(uint gpio);
+void adc_select_input(uint input);
+uint adc_get_selected_input(void);
+void adc_set_round_robin(uint input_mask);
+void adc_set_clkdiv(float clkdiv);
+void adc_fifo_setup(bool en, bool dreq_en, uint16_t dreq_thresh, bool err_in_fifo, bool byte_shift);
+void adc_run(bool run);
+void adc_fifo_drain(void);
+
+#endif
@@ -0,0 +1,14 @@
+// Host stand-in for <hardware/clocks.h>
+
+#ifndef _HARDWARE_CLOCKS_H
+#define _HARDWARE_CLOCKS_H
+
+#include "pico.h"
+
+#define CLOCKS_CLK_GPOUT0_CTRL_AUXSRC_VALUE_CLK_SYS 0x6
+#define CLOCKS_CLK_GPOUT0_CTRL_AUXSRC_VALUE_CLK_ADC 0x8
+
+// Routes a divided clock to a GPIO; the model uses the divisor to find the AD9834 MCLK
+void clock_gpio_init(uint gpio, uint src, float div);
+
+#endif
@@ -0,0 +1,17 @@
+// Host stand-in for <hardware/irq.h>
+// Only DMA_IRQ_0 is modeled; its handler runs from the simulated DMA when a channel completes.
+
+#ifndef _HARDWARE_IRQ_H
+#define _HARDWARE_IRQ_H
+
+#include "pico.h"
+
+#define DMA_IRQ_0 11
+#define DMA_IRQ_1 12
+
+typedef void (*irq_handler_t)(void);
+
+void irq_set_exclusive_handler(uint num, irq_handler_t handler);
+void irq_set_enabled(uint num, bool enabled);
+
+#endif
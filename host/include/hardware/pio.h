@@ -0,0 +1,71 @@
+// Host stand-in for <hardware/pio.h>
+// State machines are not executed; the model only tracks clock dividers and restarts, including
+// the synchronized source/LO restart of losquare.pio's srcreset program.
+
+#ifndef _HARDWARE_PIO_H
+#define _HARDWARE_PIO_H
+
+#include "pico.h"
+#include "hardware/gpio.h"
+
+#define NUM_PIO_STATE_MACHINES 4
+
+typedef struct pio_hw pio_hw_t;
+typedef pio_hw_t *PIO;
+
+extern pio_hw_t *const sim_pio0;
+extern pio_hw_t *const sim_pio1;
+#define pio0 sim_pio0
+#define pio1 sim_pio1
+
+typedef struct pio_program {
+    const uint16_t *instructions;
+    uint8_t length;
+    int8_t origin;
+} pio_program_t;
+
+typedef struct {
+    uint set_base;
+    uint set_count;
+    uint wrap_target;
+    uint wrap;
+    float clkdiv;
+} pio_sm_config;
+
+uint pio_add_program(PIO pio, const pio_program_t *program);
+pio_sm_config pio_get_default_sm_config(void);
+void pio_sm_init(PIO pio, uint sm, uint initial_pc, const pio_sm_config *config);
+void pio_gpio_init(PIO pio, uint pin);
+void pio_sm_set_consecutive_pindirs(PIO pio, uint sm, uint pin_base, uint pin_count, bool is_out);
+void pio_sm_set_enabled(PIO pio, uint sm, bool enabled);
+void pio_sm_clkdiv_restart(PIO pio, uint sm);
+void pio_sm_set_clkdiv(PIO pio, uint sm, float div);
+void pio_sm_set_clkdiv_int_frac(PIO pio, uint sm, uint16_t div_int, uint8_t div_frac);
+void pio_calculate_clkdiv8_from_float(float div, uint32_t *div_int, uint8_t *div_frac8);
+void pio_sm_restart(PIO pio, uint sm);
+void pio_sm_exec(PIO pio, uint sm, uint instr);
+void pio_set_sm_mask_enabled(PIO pio, uint32_t mask, bool enabled);
+void pio_enable_sm_mask_in_sync(PIO pio, uint32_t mask);
+void pio_interrupt_clear(PIO pio, uint irq_num);
+void pio_sm_clear_fifos(PIO pio, uint sm);
+uint pio_get_dreq(PIO pio, uint sm, bool is_tx);
+
+static inline uint pio_encode_jmp(uint addr) {
+    return 0x0000 | addr;
+}
+
+static inline void sm_config_set_set_pins(pio_sm_config *c, uint set_base, uint set_count) {
+    c->set_base = set_base;
+    c->set_count = set_count;
+}
+
+static inline void sm_config_set_clkdiv(pio_sm_config *c, float div) {
+    c->clkdiv = div;
+}
+
+static inline void sm_config_set_wrap(pio_sm_config *c, uint wrap_target, uint wrap) {
+    c->wrap_target = wrap_target;
+    c->wrap = wrap;
+}
+
+#endif
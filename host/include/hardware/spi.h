@@ -0,0 +1,34 @@
+// Host stand-in for <hardware/spi.h>
+// Words written to spi0 are decoded by the AD9834 model; each transfer costs bus time, including
+// words fed to the data register by a DMA channel paced by spi_get_dreq.
+
+#ifndef _HARDWARE_SPI_H
+#define _HARDWARE_SPI_H
+
+#include "pico.h"
+
+typedef struct spi_inst spi_inst_t;
+
+typedef struct {
+    io_rw_32 dr;
+} spi_hw_t;
+
+extern spi_inst_t *const sim_spi0;
+extern spi_inst_t *const sim_spi1;
+#define spi0 sim_spi0
+#define spi1 sim_spi1
+#define spi_default spi0
+
+typedef enum { SPI_CPOL_0 = 0, SPI_CPOL_1 = 1 } spi_cpol_t;
+typedef enum { SPI_CPHA_0 = 0, SPI_CPHA_1 = 1 } spi_cpha_t;
+typedef enum { SPI_LSB_FIRST = 0, SPI_MSB_FIRST = 1 } spi_order_t;
+
+uint spi_init(spi_inst_t *spi, uint baudrate);
+uint spi_set_baudrate(spi_inst_t *spi, uint baudrate);
+void spi_set_format(spi_inst_t *spi, uint data_bits, spi_cpol_t cpol, spi_cpha_t cpha, spi_order_t order);
+int spi_write16_blocking(spi_inst_t *spi, const uint16_t *src, size_t len);
+spi_hw_t *spi_get_hw(spi_inst_t *spi);
+uint spi_get_dreq(spi_inst_t *spi, bool is_tx);
+bool spi_is_busy(spi_inst_t *spi);
+
+#endif
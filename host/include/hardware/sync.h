@@ -0,0 +1,17 @@
+// Host stand-in for <hardware/sync.h>
+// The simulation is single-threaded; masking interrupts defers DMA_IRQ_0 until they are restored,
+// and __wfi() and __wfe() run the model up to the next interrupt. There is one core, so __sev() has
+// nothing to wake.
+
+#ifndef _HARDWARE_SYNC_H
+#define _HARDWARE_SYNC_H
+
+#include "pico.h"
+
+uint32_t save_and_disable_interrupts(void);
+void restore_interrupts(uint32_t status);
+void __wfi(void);
+void __wfe(void);
+static inline void __sev(void) {}
+
+#endif
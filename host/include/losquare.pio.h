@@ -0,0 +1,70 @@
+// Host stand-in for the pioasm output of losquare.pio
+
+#pragma once
+
+#include "hardware/pio.h"
+
+static const uint16_t losquare_program_instructions[] = {
+    0x20c4, //  0: wait   1 irq, 4
+    0xe000, //  1: set    pins, 0
+    0xe001, //  2: set    pins, 1
+    0xe003, //  3: set    pins, 3
+    0xe002, //  4: set    pins, 2
+};
+
+static const struct pio_program losquare_program = {
+    .instructions = losquare_program_instructions,
+    .length = 5,
+    .origin = -1,
+};
+
+static inline pio_sm_config losquare_program_get_default_config(uint offset) {
+    pio_sm_config c = pio_get_default_sm_config();
+    sm_config_set_wrap(&c, offset + 1, offset + 4);
+    return c;
+}
+
+#define LOSQ_SYNC_IRQ 4
+
+static inline void losquare_init(PIO pio, uint sm, uint offset, uint pin0) {
+  pio_sm_config config = losquare_program_get_default_config(offset);
+  sm_config_set_set_pins(&config, pin0, 2);
+  pio_gpio_init(pio, pin0);
+  pio_gpio_init(pio, pin0+1);
+  gpio_set_drive_strength(pin0, GPIO_DRIVE_STRENGTH_2MA);
+  gpio_set_drive_strength(pin0+1, GPIO_DRIVE_STRENGTH_2MA);
+  pio_sm_set_consecutive_pindirs(pio, sm, pin0, 2, true);
+  pio_sm_init(pio, sm, offset, &config);
+  pio_sm_set_enabled(pio, sm, true);
+}
+
+static const uint16_t srcreset_program_instructions[] = {
+    0xff01, //  0: set    pins, 1                [31]
+    0xe000, //  1: set    pins, 0
+    0xc004, //  2: irq    nowait 4
+    0x8000, //  3: push   noblock
+    0x0004, //  4: jmp    4
+};
+
+static const struct pio_program srcreset_program = {
+    .instructions = srcreset_program_instructions,
+    .length = 5,
+    .origin = -1,
+};
+
+static inline pio_sm_config srcreset_program_get_default_config(uint offset) {
+    pio_sm_config c = pio_get_default_sm_config();
+    sm_config_set_wrap(&c, offset + 0, offset + 4);
+    return c;
+}
+
+#define SRCRESET_PULSE_CYCLES 32
+
+static inline void srcreset_init(PIO pio, uint sm, uint offset, uint pin, float clkdiv) {
+  pio_sm_config config = srcreset_program_get_default_config(offset);
+  sm_config_set_set_pins(&config, pin, 1);
+  sm_config_set_clkdiv(&config, clkdiv);
+  pio_gpio_init(pio, pin);
+  pio_sm_set_consecutive_pindirs(pio, sm, pin, 1, true);
+  pio_sm_init(pio, sm, offset, &config);
+}
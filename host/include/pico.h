@@ -0,0 +1,23 @@
+// Host stand-in for the Pico SDK base header.
+// Only what the measurement chain uses is provided; see host/sim_hw.c for the model behind it.
+
+#ifndef _PICO_H
+#define _PICO_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef unsigned int uint;
+
+typedef volatile uint32_t io_rw_32;
+typedef const volatile uint32_t io_ro_32;
+
+static inline void tight_loop_contents() {}
+
+// The firmware runs the system clock at 150MHz (the AD9834 reference is derived from it)
+#ifndef SYS_CLK_KHZ
+#define SYS_CLK_KHZ 150000
+#endif
+
+#endif
@@ -0,0 +1,6 @@
+// Host stand-in for <pico/binary_info.h> (nothing to embed on the host)
+
+#ifndef _PICO_BINARY_INFO_H
+#define _PICO_BINARY_INFO_H
+
+#endif
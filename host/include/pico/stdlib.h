@@ -0,0 +1,10 @@
+// Host stand-in for <pico/stdlib.h>
+
+#ifndef _PICO_STDLIB_H
+#define _PICO_STDLIB_H
+
+#include "pico.h"
+#include "pico/time.h"
+#include "hardware/gpio.h"
+
+#endif
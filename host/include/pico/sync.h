@@ -0,0 +1,9 @@
+// Host stand-in for <pico/sync.h>
+
+#ifndef _PICO_SYNC_H
+#define _PICO_SYNC_H
+
+#include "pico.h"
+#include "hardware/sync.h"
+
+#endif
@@ -0,0 +1,17 @@
+// Host stand-in for <pico/time.h>
+// Sleeping advances the simulated clock instantly instead of blocking.
+
+#ifndef _PICO_TIME_H
+#define _PICO_TIME_H
+
+#include "pico.h"
+
+void sleep_us(uint64_t us);
+void sleep_ms(uint32_t ms);
+
+uint64_t time_us_64(void);
+static inline uint32_t time_us_32(void) {
+    return (uint32_t) time_us_64();
+}
+
+#endif
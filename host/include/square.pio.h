@@ -0,0 +1,31 @@
+// Host stand-in for the pioasm output of square.pio
+
+#pragma once
+
+#include "hardware/pio.h"
+
+static const uint16_t square_program_instructions[] = {
+    0xe081, //  0: set    pindirs, 1
+    0xe001, //  1: set    pins, 1
+    0xe000, //  2: set    pins, 0
+};
+
+static const struct pio_program square_program = {
+    .instructions = square_program_instructions,
+    .length = 3,
+    .origin = -1,
+};
+
+static inline pio_sm_config square_program_get_default_config(uint offset) {
+    pio_sm_config c = pio_get_default_sm_config();
+    sm_config_set_wrap(&c, offset + 1, offset + 2);
+    return c;
+}
+
+static inline void square_init(PIO pio, uint sm, uint offset, uint pin) {
+  pio_sm_config config = square_program_get_default_config(offset);
+  sm_config_set_set_pins(&config, pin, 1);
+  pio_sm_init(pio, sm, offset, &config);
+  pio_sm_set_enabled(pio, sm, true);
+  pio_gpio_init(pio, pin);
+}
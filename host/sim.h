@@ -0,0 +1,75 @@
+/* Synthetic model of the SuperVNA analog front end, used by the host simulation build.
+   The stand-in SDK headers in host/include feed every GPIO, SPI, PIO and ADC access
+   into this model, which turns the programmed source/LO frequencies, path switches and
+   phase resets into Tayloe I/Q samples for a configurable DUT.
+*/
+
+#ifndef SIM_H
+#define SIM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "complex_math.h"
+#include "vna.h"
+
+// Kinds of device the model can have connected to the port
+typedef enum {
+    SIM_DUT_SHORT,
+    SIM_DUT_OPEN,
+    SIM_DUT_LOAD,
+    SIM_DUT_RLC     // Series R-L-C to ground
+} sim_dut_kind_t;
+
+// Device under test
+typedef struct {
+    sim_dut_kind_t kind;
+    double r;   // Ohms
+    double l;   // Henries
+    double c;   // Farads (<= 0 for no capacitor)
+} sim_dut_t;
+
+// Model parameters
+typedef struct {
+    double ref_amplitude;   // Incident signal amplitude at the ADC (counts)
+    double ref_rolloff_khz; // -3dB corner of the incident path
+    double adc_bias;        // DC level of the Tayloe outputs (counts)
+    double noise_rms;       // Additive noise at the ADC (counts rms)
+    double settle_tau_us;   // Time constant of the detector outputs settling after a path,
+                            // frequency or phase-reset change
+    bool dual_detector;     // A second detector on the reflected path, its I/Q on ADC_RFL_I/ADC_RFL_Q.
+                            // Otherwise both paths share the detector on ADC_I/ADC_Q.
+
+    // Bridge error network: Gamma_meas = e00 + e10e01*Gamma/(1 - e11*Gamma)
+    double e00_mag;         // Directivity
+    double e11_mag;         // Source match
+    double tracking_mag;    // |e10e01|
+    double delay_ns;        // One-way delay from the bridge to the port
+
+    const vna_cal_kit_t *cal_kit;   // What the short, open and load DUTs actually are (NULL for ideal)
+
+    uint32_t seed;          // Noise generator seed
+} sim_config_t;
+
+// Default model parameters, roughly matching the breadboard
+sim_config_t sim_default_config();
+
+// Resets the model (and simulated time) with the given parameters
+void sim_init(const sim_config_t *config);
+
+// Connects a device to the port
+void sim_set_dut(sim_dut_t dut);
+
+// Actual reflection coefficient of the connected device at a frequency in kHz
+double_cplx_t sim_dut_gamma(double freq);
+
+// Frequency the source is actually producing, in kHz
+double sim_src_freq();
+
+// Frequency the Tayloe LO is actually at, in kHz
+double sim_lo_freq();
+
+// Times the ADC was started as soon as its DMA trigger was armed, by a PIO RX DREQ left asserted
+// from an earlier restart, instead of by the restart it was armed for
+uint32_t sim_early_adc_starts();
+
+#endif
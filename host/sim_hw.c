@@ -0,0 +1,934 @@
+/* Host implementation of the stand-in Pico SDK, backed by a synthetic model of the board.
+
+   Time is simulated: sleeps, SPI transfers and ADC conversions advance a microsecond clock
+   instead of blocking, so a full sweep runs in a few milliseconds of host time. While the ADC
+   runs, its conversions are produced as time advances (and before any change to the model's
+   state), feeding whichever DMA channel it paces; completed channels chain and raise DMA_IRQ_0.
+
+   The source and LO are tracked as phase accumulators fed by whatever the drivers program
+   (AD9834 tuning words over SPI, PIO clock dividers). The Tayloe outputs are then
+   I + jQ = bias + s*exp(j*(phase_src - phase_lo)), where s is the incident signal and/or
+   the incident signal times the bridge's measured reflection coefficient, depending on
+   which receiver path switches are enabled. With a dual detector, the reflected path has
+   its own I/Q outputs on ADC_RFL_I/ADC_RFL_Q. After any change of path, frequency or phase
+   reset, s settles exponentially from zero.
+*/
+
+#include "sim.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pico/stdlib.h>
+#include <hardware/adc.h>
+#include <hardware/dma.h>
+#include <hardware/irq.h>
+#include <hardware/sync.h>
+#include <hardware/clocks.h>
+#include <hardware/pio.h>
+#include <hardware/spi.h>
+#include "vna.h"
+#include "ad9834.h"
+
+#define SYS_CLK_HZ ((double) SYS_CLK_KHZ * 1000.0)
+#define ADC_CLK_HZ 48000000.0
+#define ADC_CYCLES_PER_SAMPLE 96
+#define ADC_NUM_INPUTS 5
+#define Z0 50.0
+
+// Model configuration and connected device
+static sim_config_t cfg;
+static sim_dut_t dut;
+
+// Simulated time (us)
+static uint64_t now_us;
+
+// GPIO output levels
+static bool gpio_out[NUM_BANK0_GPIOS];
+
+// Noise generator state
+static uint32_t rng_state;
+
+// Time of the last change the detector outputs have to settle from (us)
+static uint64_t t_disturb;
+
+// ADC starts by a PIO RX DREQ that was already asserted when its DMA channel was armed
+static uint32_t early_adc_starts;
+
+// Phase accumulator of a free-running oscillator, in cycles
+typedef struct {
+    double freq;        // Hz
+    double phase;       // Cycles at t_base
+    uint64_t t_base;    // us
+    bool running;
+} osc_t;
+
+// AD9834 model
+static struct {
+    uint32_t freq_reg[2];
+    bool lsb_next[2];   // B28 mode: next write to this register is the LSBs
+    uint16_t control;
+    double mclk;        // Hz
+    osc_t osc;
+} dds;
+
+// Tayloe LO model (pio1, sm 0)
+struct pio_hw {
+    float clkdiv[NUM_PIO_STATE_MACHINES];
+    bool enabled[NUM_PIO_STATE_MACHINES];
+    uint rx_level[NUM_PIO_STATE_MACHINES];  // Words in each RX FIFO; only srcreset pushes
+    uint next_offset;
+};
+static struct pio_hw pio_insts[2];
+pio_hw_t *const sim_pio0 = &pio_insts[0];
+pio_hw_t *const sim_pio1 = &pio_insts[1];
+static osc_t lo;
+
+// SPI peripherals
+struct spi_inst {
+    spi_hw_t hw;
+    uint baudrate;
+    uint data_bits;
+    double t_next;  // When the word being shifted out by a paced DMA channel is done (us)
+};
+static struct spi_inst spi_insts[2];
+spi_inst_t *const sim_spi0 = &spi_insts[0];
+spi_inst_t *const sim_spi1 = &spi_insts[1];
+
+// ADC model
+adc_hw_t sim_adc_regs;
+static struct {
+    uint input;
+    uint rr_mask;
+    bool byte_shift;
+    bool running;
+    double period_us;
+    uint64_t t_start;
+    uint64_t conversions;   // Conversions since adc_run(true)
+} adc;
+
+// DMA model
+static struct {
+    bool claimed;
+    bool busy;
+    dma_channel_config config;
+    volatile void *write_addr;
+    const volatile void *read_addr;
+    uint count;         // Remaining transfers
+    uint reload_count;  // Transfer count loaded when triggered
+    bool irq0_enabled;
+} dma[NUM_DMA_CHANNELS];
+static uint32_t dma_ints0;
+
+// Interrupts
+static irq_handler_t dma_irq0_handler;
+static bool dma_irq0_enabled;
+static bool irqs_masked;
+static bool irq_taken;      // Set whenever a handler runs, for __wfi and __wfe
+
+
+/*************** MODEL ***************/
+
+sim_config_t sim_default_config() {
+    return (sim_config_t) {
+        .ref_amplitude = 900.0,
+        .ref_rolloff_khz = 40000.0,
+        .adc_bias = 2048.0,
+        .noise_rms = 1.0,
+        .settle_tau_us = 500.0,
+        .dual_detector = false,
+        .e00_mag = 0.08,
+        .e11_mag = 0.12,
+        .tracking_mag = 0.45,
+        .delay_ns = 2.0,
+        .cal_kit = NULL,
+        .seed = 1
+    };
+}
+
+void sim_init(const sim_config_t *config) {
+    cfg = config ? *config : sim_default_config();
+    dut = (sim_dut_t) {SIM_DUT_LOAD, Z0, 0.0, 0.0};
+    rng_state = cfg.seed ? cfg.seed : 1;
+
+    now_us = 0;
+    t_disturb = 0;
+    early_adc_starts = 0;
+    memset(gpio_out, 0, sizeof(gpio_out));
+    memset(&dds, 0, sizeof(dds));
+    memset(pio_insts, 0, sizeof(pio_insts));
+    memset(&lo, 0, sizeof(lo));
+    memset(spi_insts, 0, sizeof(spi_insts));
+    memset(&adc, 0, sizeof(adc));
+    memset(dma, 0, sizeof(dma));
+    dma_ints0 = 0;
+    dma_irq0_handler = NULL;
+    dma_irq0_enabled = false;
+    irqs_masked = false;
+    adc.period_us = ADC_CYCLES_PER_SAMPLE * 1e6 / ADC_CLK_HZ;
+}
+
+void sim_set_dut(sim_dut_t new_dut) {
+    dut = new_dut;
+}
+
+double_cplx_t sim_dut_gamma(double freq) {
+    if(cfg.cal_kit) {
+        vna_cal_standards_t stds = vna_cal_kit_standards(cfg.cal_kit, freq);
+        switch(dut.kind) {
+            case SIM_DUT_SHORT: return stds.g_short;
+            case SIM_DUT_OPEN:  return stds.g_open;
+            case SIM_DUT_LOAD:  return stds.g_load;
+            default: break;
+        }
+    }
+
+    switch(dut.kind) {
+        case SIM_DUT_SHORT: return (double_cplx_t) {-1.0, 0.0};
+        case SIM_DUT_OPEN:  return (double_cplx_t) {1.0, 0.0};
+        case SIM_DUT_LOAD:  return cplx_zero;
+        default: break;
+    }
+
+    double w = 2.0 * MATH_PI * freq * 1000.0;
+    double_cplx_t z = {dut.r, w * dut.l};
+    if(dut.c > 0) z.b -= 1.0 / (w * dut.c);
+
+    double_cplx_t num = {z.a - Z0, z.b};
+    double_cplx_t den = {z.a + Z0, z.b};
+    return cplx_div(num, den);
+}
+
+double sim_src_freq() {
+    return dds.osc.freq / 1000.0;
+}
+
+double sim_lo_freq() {
+    return lo.freq / 1000.0;
+}
+
+uint32_t sim_early_adc_starts() {
+    return early_adc_starts;
+}
+
+// Phase of an oscillator at time t (us), in cycles
+static double osc_phase(const osc_t *osc, uint64_t t) {
+    if(!osc->running || t < osc->t_base) return osc->phase;
+    return osc->phase + osc->freq * (double)(t - osc->t_base) * 1e-6;
+}
+
+// Moves the accumulated phase up to now so the frequency or run state can change
+static void osc_rebase(osc_t *osc) {
+    if(now_us < osc->t_base) return;    // Still waiting to start from a synchronized restart
+    osc->phase = fmod(osc_phase(osc, now_us), 1.0);
+    osc->t_base = now_us;
+}
+
+static double_cplx_t cplx_expj(double theta) {
+    return (double_cplx_t) {cos(theta), sin(theta)};
+}
+
+// Incident signal at the ADC for the current source frequency
+static double_cplx_t incident_signal(double f_khz) {
+    double x = f_khz / cfg.ref_rolloff_khz;
+    return cplx_scale(cplx_expj(-atan(x)), cfg.ref_amplitude / sqrt(1.0 + x*x));
+}
+
+// Reflection coefficient seen at the bridge, after the error network
+static double_cplx_t bridge_gamma(double f_khz) {
+    double wt = 2.0 * MATH_PI * f_khz * 1000.0 * cfg.delay_ns * 1e-9;
+    double_cplx_t e00 = cplx_scale(cplx_expj(-0.5 * wt + 0.3), cfg.e00_mag);
+    double_cplx_t e11 = cplx_scale(cplx_expj(-wt - 0.2), cfg.e11_mag);
+    double_cplx_t trk = cplx_scale(cplx_expj(-2.0 * wt + 0.4), cfg.tracking_mag);
+
+    double_cplx_t g = sim_dut_gamma(f_khz);
+    double_cplx_t one_minus = cplx_sub(cplx_unity, cplx_mult(e11, g));
+    double_cplx_t tg = cplx_mult(trk, g);
+    return cplx_add(e00, cplx_div(tg, one_minus));
+}
+
+// Standard normal deviate
+static double randn() {
+    double u[2];
+    for(int i = 0; i < 2; i++) {
+        rng_state ^= rng_state << 13;
+        rng_state ^= rng_state >> 17;
+        rng_state ^= rng_state << 5;
+        u[i] = (rng_state + 1.0) / 4294967297.0;
+    }
+    return sqrt(-2.0 * log(u[0])) * cos(2.0 * MATH_PI * u[1]);
+}
+
+// Converts one sample on an ADC input at time t (us)
+static uint16_t adc_convert(uint input, uint64_t t) {
+    double_cplx_t inc_path = cplx_zero;     // Detector on ADC_I/ADC_Q
+    double_cplx_t rfl_path = cplx_zero;     // Detector on ADC_RFL_I/ADC_RFL_Q, if dual
+    bool src_on = dds.osc.running && !gpio_out[SRC_RESET];
+
+    if(src_on && lo.freq > 0) {
+        double f_khz = dds.osc.freq / 1000.0;
+        double_cplx_t inc = incident_signal(f_khz);
+        double_cplx_t rfl = cplx_mult(inc, bridge_gamma(f_khz));
+        if(!gpio_out[RX_INCT_EN]) inc_path = cplx_add(inc_path, inc);
+        if(!gpio_out[RX_REFL_EN]) {
+            if(cfg.dual_detector) rfl_path = rfl;
+            else inc_path = cplx_add(inc_path, rfl);
+        }
+
+        double theta = 2.0 * MATH_PI * (osc_phase(&dds.osc, t) - osc_phase(&lo, t));
+        double_cplx_t rot = cplx_expj(theta);
+        if(cfg.settle_tau_us > 0) {
+            double settled = t > t_disturb ? 1.0 - exp(-(double)(t - t_disturb) / cfg.settle_tau_us) : 0.0;
+            rot = cplx_scale(rot, settled);
+        }
+        inc_path = cplx_mult(inc_path, rot);
+        rfl_path = cplx_mult(rfl_path, rot);
+    }
+
+    double v = cfg.adc_bias + cfg.noise_rms * randn();
+    if(input == ADC_I - 26) v += inc_path.a;
+    else if(input == ADC_Q - 26) v += inc_path.b;
+    else if(input == ADC_RFL_I - 26) v += rfl_path.a;
+    else if(input == ADC_RFL_Q - 26) v += rfl_path.b;
+
+    long code = lround(v);
+    if(code < 0) code = 0;
+    if(code > 4095) code = 4095;
+    return adc.byte_shift ? (uint16_t)(code >> 4) : (uint16_t)code;
+}
+
+// Runs DMA_IRQ_0's handler if anything is pending and interrupts allow it
+static void dma_irq_check() {
+    if(dma_ints0 && dma_irq0_enabled && dma_irq0_handler && !irqs_masked) {
+        irq_taken = true;
+        dma_irq0_handler();
+    }
+}
+
+// Time to shift one word out of an SPI (us)
+static double spi_word_us(const spi_inst_t *spi) {
+    return spi->data_bits * 1e6 / spi->baudrate;
+}
+
+// SPI whose TX a DREQ paces, or NULL
+static spi_inst_t *spi_for_dreq(uint dreq) {
+    if(dreq == DREQ_SPI0_TX) return spi0;
+    if(dreq == DREQ_SPI1_TX) return spi1;
+    return NULL;
+}
+
+// Level of the PIO RX FIFO whose DREQ is dreq, or NULL
+static uint *pio_rx_level_for_dreq(uint dreq) {
+    if(dreq >= DREQ_PIO0_RX0 && dreq < DREQ_PIO0_RX0 + NUM_PIO_STATE_MACHINES) return &pio_insts[0].rx_level[dreq - DREQ_PIO0_RX0];
+    if(dreq >= DREQ_PIO1_RX0 && dreq < DREQ_PIO1_RX0 + NUM_PIO_STATE_MACHINES) return &pio_insts[1].rx_level[dreq - DREQ_PIO1_RX0];
+    return NULL;
+}
+
+static bool dma_pio_rx_paced(uint ch, uint64_t t);
+
+// Starts a channel from its current write address with its reload count
+static void dma_trigger(uint ch) {
+    dma[ch].count = dma[ch].reload_count;
+    dma[ch].busy = dma[ch].count > 0;
+
+    spi_inst_t *spi = spi_for_dreq(dma[ch].config.dreq);
+    if(spi && dma[ch].busy) spi->t_next = now_us + spi_word_us(spi);
+    if(dma[ch].busy && dma_pio_rx_paced(ch, now_us)) early_adc_starts++;
+}
+
+// Moves one word into a channel, completing (and chaining) it on the last one
+static void dma_transfer(uint ch, uint32_t word) {
+    uint size = 1u << dma[ch].config.size;
+    memcpy((void *) dma[ch].write_addr, &word, size);
+    if(dma[ch].config.write_increment) dma[ch].write_addr = (uint8_t *) dma[ch].write_addr + size;
+    if(dma[ch].config.read_increment) dma[ch].read_addr = (const uint8_t *) dma[ch].read_addr + size;
+
+    if(--dma[ch].count == 0) {
+        dma[ch].busy = false;
+        if(dma[ch].irq0_enabled) dma_ints0 |= 1u << ch;
+        if(dma[ch].config.chain_to != ch) dma_trigger(dma[ch].config.chain_to);
+        dma_irq_check();
+    }
+}
+
+// Runs a channel paced by a PIO RX DREQ if that FIFO holds a word. The DREQ stays asserted until
+// the FIFO is read or cleared, and no channel here reads it, so the whole transfer happens at t.
+// Writing START_MANY to the ADC's control register starts the ADC at t. Returns whether it did.
+static bool dma_pio_rx_paced(uint ch, uint64_t t) {
+    uint *rx_level = pio_rx_level_for_dreq(dma[ch].config.dreq);
+    if(!rx_level || *rx_level == 0) return false;
+
+    bool adc_started = false;
+    while(dma[ch].busy) {
+        uint32_t word = 0;
+        memcpy(&word, (const void *) dma[ch].read_addr, 1u << dma[ch].config.size);
+        dma_transfer(ch, word);
+        if(dma[ch].write_addr == &adc_hw->cs && (word & ADC_CS_START_MANY_BITS) && !adc.running) {
+            adc.running = true;
+            adc.t_start = t;
+            adc.conversions = 0;
+            adc_started = true;
+        }
+    }
+    return adc_started;
+}
+
+// Channel currently paced by the ADC, or -1
+static int adc_dma_channel() {
+    for(int ch = 0; ch < NUM_DMA_CHANNELS; ch++) {
+        if(dma[ch].busy && dma[ch].config.dreq == DREQ_ADC && dma[ch].read_addr == &adc_hw->fifo) return ch;
+    }
+    return -1;
+}
+
+// Channel feeding an SPI's TX, or -1
+static int spi_dma_channel(spi_inst_t *spi) {
+    for(int ch = 0; ch < NUM_DMA_CHANNELS; ch++) {
+        if(dma[ch].busy && spi_for_dreq(dma[ch].config.dreq) == spi && dma[ch].write_addr == &spi->hw.dr) return ch;
+    }
+    return -1;
+}
+
+// Time the AD9834's SPI next finishes a word from DMA (us), or UINT64_MAX if it isn't sending
+static uint64_t spi_next_time() {
+    return spi_dma_channel(spi_default) >= 0 ? (uint64_t) ceil(spi_default->t_next) : UINT64_MAX;
+}
+
+static void ad9834_write(uint16_t word);
+
+// Shifts the next DMA-fed word out to the AD9834
+static void spi_dma_word() {
+    int ch = spi_dma_channel(spi_default);
+    uint32_t word = 0;
+    memcpy(&word, (const void *) dma[ch].read_addr, 1u << dma[ch].config.size);
+    spi_default->t_next += spi_word_us(spi_default);
+    dma_transfer(ch, word);
+    ad9834_write(word);
+}
+
+// Time of the ADC's next conversion (us)
+static uint64_t adc_next_time() {
+    return adc.t_start + (uint64_t) llround((adc.conversions + 1) * adc.period_us);
+}
+
+// Produces every ADC conversion due up to time t, handing each to the paced DMA channel (if any),
+// then moves time on to t
+static void run_until(uint64_t t) {
+    static bool running;
+    if(running) return;     // Called again from an interrupt handler
+    running = true;
+
+    while(true) {
+        // SPI words from DMA and ADC conversions, in time order
+        uint64_t t_spi = spi_next_time();
+        uint64_t t_conv = adc.running ? adc_next_time() : UINT64_MAX;
+        if(t_spi <= t && t_spi <= t_conv) {
+            if(t_spi > now_us) now_us = t_spi;
+            spi_dma_word();
+            continue;
+        }
+        if(t_conv > t) break;
+
+        if(t_conv > now_us) now_us = t_conv;
+        uint16_t sample = adc_convert(adc.input, t_conv);
+        adc.conversions++;
+
+        // Round-robin moves on to the next enabled input after each conversion
+        if(adc.rr_mask) {
+            do {
+                adc.input = (adc.input + 1) % ADC_NUM_INPUTS;
+            } while(!(adc.rr_mask & (1u << adc.input)));
+        }
+
+        int ch = adc_dma_channel();
+        if(ch >= 0) dma_transfer(ch, sample);
+    }
+    if(t > now_us) now_us = t;
+
+    running = false;
+}
+
+// Brings the ADC up to now before the model's state changes
+static void run_to_now() {
+    run_until(now_us);
+}
+
+// Applies a 16-bit word written to the AD9834
+static void ad9834_write(uint16_t word) {
+    run_to_now();
+    switch(word >> 14) {
+        case 0: {   // Control
+            dds.control = word;
+            break;
+        }
+        case 1:     // FREQ0
+        case 2: {   // FREQ1
+            int reg = (word >> 14) - 1;
+            uint32_t bits = word & 0x3FFF;
+            if(!(dds.control & 0x2000)) {
+                // HLB selects which half gets written
+                if(dds.control & 0x1000) dds.freq_reg[reg] = (dds.freq_reg[reg] & 0x3FFF) | (bits << 14);
+                else dds.freq_reg[reg] = (dds.freq_reg[reg] & 0xFFFC000) | bits;
+            } else if(!dds.lsb_next[reg]) {
+                dds.freq_reg[reg] = (dds.freq_reg[reg] & 0xFFFC000) | bits;
+                dds.lsb_next[reg] = true;
+            } else {
+                dds.freq_reg[reg] = (dds.freq_reg[reg] & 0x3FFF) | (bits << 14);
+                dds.lsb_next[reg] = false;
+            }
+            break;
+        }
+        default:    // Phase registers are not modeled
+            break;
+    }
+
+    int fsel = (dds.control & 0x800) ? 1 : 0;
+    double freq = dds.freq_reg[fsel] * dds.mclk / (double)(1 << 28);
+    osc_rebase(&dds.osc);
+    if(freq != dds.osc.freq) t_disturb = now_us;
+    dds.osc.freq = freq;
+}
+
+// Recomputes the LO frequency from the Tayloe state machine's clock divider
+static void lo_update() {
+    struct pio_hw *p = TAYLOE_PIO;
+    run_to_now();
+    double freq = p->clkdiv[0] > 0 ? SYS_CLK_HZ / p->clkdiv[0] / 4.0 : 0.0;
+    osc_rebase(&lo);
+    if(freq != lo.freq || p->enabled[0] != lo.running) t_disturb = now_us;
+    lo.running = p->enabled[0];
+    lo.freq = freq;
+}
+
+
+/*************** TIME ***************/
+
+void sleep_us(uint64_t us) {
+    run_until(now_us + us);
+}
+
+void sleep_ms(uint32_t ms) {
+    run_until(now_us + (uint64_t) ms * 1000);
+}
+
+uint64_t time_us_64() {
+    return now_us;
+}
+
+
+/*************** GPIO / CLOCKS ***************/
+
+void gpio_init(uint gpio) {
+    gpio_out[gpio] = false;
+}
+
+void gpio_set_dir(uint gpio, bool out) {
+    (void) gpio;
+    (void) out;
+}
+
+void gpio_set_function(uint gpio, enum gpio_function fn) {
+    (void) gpio;
+    (void) fn;
+}
+
+void gpio_set_drive_strength(uint gpio, enum gpio_drive_strength drive) {
+    (void) gpio;
+    (void) drive;
+}
+
+void gpio_put(uint gpio, bool value) {
+    run_to_now();
+    // Releasing the DDS reset restarts its phase accumulator from zero
+    if(gpio == SRC_RESET && gpio_out[gpio] && !value) {
+        dds.osc.phase = 0.0;
+        dds.osc.t_base = now_us;
+        t_disturb = now_us;
+    }
+    // Switching a receiver path in or out
+    if((gpio == RX_INCT_EN || gpio == RX_REFL_EN) && gpio_out[gpio] != value) {
+        t_disturb = now_us;
+    }
+    if(gpio == SRC_RESET && value) {
+        osc_rebase(&dds.osc);
+    }
+    gpio_out[gpio] = value;
+}
+
+bool gpio_get(uint gpio) {
+    return gpio_out[gpio];
+}
+
+void clock_gpio_init(uint gpio, uint src, float div) {
+    (void) src;
+    if(gpio == AD9834_REF) {
+        dds.mclk = SYS_CLK_HZ / div;
+        dds.osc.running = true;
+    }
+}
+
+
+/*************** SPI ***************/
+
+uint spi_init(spi_inst_t *spi, uint baudrate) {
+    spi->data_bits = 8;
+    return spi_set_baudrate(spi, baudrate);
+}
+
+uint spi_set_baudrate(spi_inst_t *spi, uint baudrate) {
+    spi->baudrate = baudrate;
+    return baudrate;
+}
+
+void spi_set_format(spi_inst_t *spi, uint data_bits, spi_cpol_t cpol, spi_cpha_t cpha, spi_order_t order) {
+    (void) cpol;
+    (void) cpha;
+    (void) order;
+    spi->data_bits = data_bits;
+}
+
+spi_hw_t *spi_get_hw(spi_inst_t *spi) {
+    return &spi->hw;
+}
+
+uint spi_get_dreq(spi_inst_t *spi, bool is_tx) {
+    if(spi == spi0) return is_tx ? DREQ_SPI0_TX : DREQ_SPI0_RX;
+    return is_tx ? DREQ_SPI1_TX : DREQ_SPI1_RX;
+}
+
+bool spi_is_busy(spi_inst_t *spi) {
+    run_to_now();
+    return spi_dma_channel(spi) >= 0;
+}
+
+int spi_write16_blocking(spi_inst_t *spi, const uint16_t *src, size_t len) {
+    for(size_t i = 0; i < len; i++) {
+        run_until(now_us + (uint64_t) ceil(spi->data_bits * 1e6 / spi->baudrate));
+        if(spi == spi_default) ad9834_write(src[i]);
+    }
+    return (int) len;
+}
+
+
+/*************** PIO ***************/
+
+uint pio_add_program(PIO pio, const pio_program_t *program) {
+    uint offset = pio->next_offset;
+    pio->next_offset += program->length;
+    return offset;
+}
+
+pio_sm_config pio_get_default_sm_config() {
+    return (pio_sm_config) {.clkdiv = 1.0f};
+}
+
+void pio_sm_init(PIO pio, uint sm, uint initial_pc, const pio_sm_config *config) {
+    (void) initial_pc;
+    pio->enabled[sm] = false;
+    pio->clkdiv[sm] = config->clkdiv;
+    pio->rx_level[sm] = 0;  // pio_sm_init clears the FIFOs
+    if(pio == TAYLOE_PIO && sm == 0) lo_update();
+}
+
+void pio_gpio_init(PIO pio, uint pin) {
+    (void) pio;
+    (void) pin;
+}
+
+void pio_sm_set_consecutive_pindirs(PIO pio, uint sm, uint pin_base, uint pin_count, bool is_out) {
+    (void) pio;
+    (void) sm;
+    (void) pin_base;
+    (void) pin_count;
+    (void) is_out;
+}
+
+void pio_sm_set_enabled(PIO pio, uint sm, bool enabled) {
+    pio->enabled[sm] = enabled;
+    if(pio == TAYLOE_PIO && sm == 0) lo_update();
+}
+
+// Only resets the fractional divider counter, which is well under one LO cycle
+void pio_sm_clkdiv_restart(PIO pio, uint sm) {
+    (void) pio;
+    (void) sm;
+}
+
+void pio_sm_set_clkdiv_int_frac(PIO pio, uint sm, uint16_t div_int, uint8_t div_frac) {
+    pio->clkdiv[sm] = (float) div_int + (float) div_frac / 256.0f;
+    if(pio == TAYLOE_PIO && sm == 0) lo_update();
+}
+
+void pio_sm_restart(PIO pio, uint sm) {
+    (void) pio;
+    (void) sm;
+}
+
+void pio_sm_exec(PIO pio, uint sm, uint instr) {
+    (void) pio;
+    (void) sm;
+    (void) instr;
+}
+
+void pio_interrupt_clear(PIO pio, uint irq_num) {
+    (void) pio;
+    (void) irq_num;
+}
+
+void pio_sm_clear_fifos(PIO pio, uint sm) {
+    pio->rx_level[sm] = 0;
+}
+
+uint pio_get_dreq(PIO pio, uint sm, bool is_tx) {
+    return (pio == pio0 ? DREQ_PIO0_TX0 : DREQ_PIO1_TX0) + (is_tx ? 0 : 4) + sm;
+}
+
+void pio_set_sm_mask_enabled(PIO pio, uint32_t mask, bool enabled) {
+    for(uint sm = 0; sm < NUM_PIO_STATE_MACHINES; sm++) {
+        if(mask & (1u << sm)) pio_sm_set_enabled(pio, sm, enabled);
+    }
+}
+
+// Starting the LO together with srcreset is the synchronized restart: the source is held in reset
+// for SRCRESET_PULSE_CYCLES of srcreset's clock, then it and the LO both start from phase zero,
+// and srcreset's push into its RX FIFO starts the ADC if a DMA channel paced by its RX DREQ writes
+// the ADC's control register. A word left there from an earlier restart would have started that
+// channel as soon as it was armed instead.
+void pio_enable_sm_mask_in_sync(PIO pio, uint32_t mask) {
+    uint32_t sync_mask = (1u << 0) | (1u << RX_SYNC_SM);
+    if(pio != TAYLOE_PIO || (mask & sync_mask) != sync_mask) {
+        pio_set_sm_mask_enabled(pio, mask, true);
+        return;
+    }
+
+    run_to_now();
+    uint64_t t_release = now_us + (uint64_t) llround(SRCRESET_PULSE_CYCLES * pio->clkdiv[RX_SYNC_SM] * 1e6 / SYS_CLK_HZ);
+    pio_set_sm_mask_enabled(pio, mask, true);
+    dds.osc.phase = 0.0;
+    dds.osc.t_base = t_release;
+    lo.phase = 0.0;
+    lo.t_base = t_release;
+    t_disturb = t_release;
+
+    // push noblock drops the word if the 4-deep FIFO is full
+    if(pio->rx_level[RX_SYNC_SM] < 4) pio->rx_level[RX_SYNC_SM]++;
+    for(uint ch = 0; ch < NUM_DMA_CHANNELS; ch++) {
+        if(dma[ch].busy) dma_pio_rx_paced(ch, t_release);
+    }
+}
+
+void pio_calculate_clkdiv8_from_float(float div, uint32_t *div_int, uint8_t *div_frac8) {
+    *div_int = (uint32_t) div;
+    *div_frac8 = *div_int ? (uint8_t)((div - (float) *div_int) * 256.0f) : 0;
+}
+
+void pio_sm_set_clkdiv(PIO pio, uint sm, float div) {
+    uint32_t div_int;
+    uint8_t div_frac8;
+    pio_calculate_clkdiv8_from_float(div, &div_int, &div_frac8);
+    pio_sm_set_clkdiv_int_frac(pio, sm, div_int, div_frac8);
+}
+
+
+/*************** ADC ***************/
+
+void adc_init() {
+    memset(&sim_adc_regs, 0, sizeof(sim_adc_regs));
+    adc.input = 0;
+    adc.rr_mask = 0;
+    adc.running = false;
+}
+
+void adc_gpio_init(uint gpio) {
+    (void) gpio;
+}
+
+void adc_select_input(uint input) {
+    run_to_now();
+    adc.input = input;
+}
+
+uint adc_get_selected_input() {
+    return adc.input;
+}
+
+void adc_set_round_robin(uint input_mask) {
+    run_to_now();
+    adc.rr_mask = input_mask;
+}
+
+void adc_set_clkdiv(float clkdiv) {
+    // Conversions take 96 cycles; a divider below that runs back-to-back
+    double cycles = clkdiv + 1.0 < ADC_CYCLES_PER_SAMPLE ? ADC_CYCLES_PER_SAMPLE : clkdiv + 1.0;
+    adc.period_us = cycles * 1e6 / ADC_CLK_HZ;
+}
+
+void adc_fifo_setup(bool en, bool dreq_en, uint16_t dreq_thresh, bool err_in_fifo, bool byte_shift) {
+    (void) en;
+    (void) dreq_en;
+    (void) dreq_thresh;
+    (void) err_in_fifo;
+    adc.byte_shift = byte_shift;
+}
+
+void adc_run(bool run) {
+    run_to_now();
+    if(run && !adc.running) {
+        adc.t_start = now_us;
+        adc.conversions = 0;
+    }
+    adc.running = run;
+}
+
+void adc_fifo_drain() {
+}
+
+
+/*************** DMA ***************/
+
+int dma_claim_unused_channel(bool required) {
+    for(int ch = 0; ch < NUM_DMA_CHANNELS; ch++) {
+        if(!dma[ch].claimed) {
+            dma[ch].claimed = true;
+            return ch;
+        }
+    }
+    if(required) {
+        fprintf(stderr, "sim: no DMA channels left\n");
+        abort();
+    }
+    return -1;
+}
+
+void dma_channel_unclaim(uint channel) {
+    dma[channel].claimed = false;
+}
+
+dma_channel_config dma_channel_get_default_config(uint channel) {
+    return (dma_channel_config) {DMA_SIZE_32, true, false, 0x3f, channel};
+}
+
+void dma_channel_configure(uint channel, const dma_channel_config *config, volatile void *write_addr,
+                           const volatile void *read_addr, uint transfer_count, bool trigger) {
+    run_to_now();
+    dma[channel].config = *config;
+    dma[channel].write_addr = write_addr;
+    dma[channel].read_addr = read_addr;
+    dma[channel].reload_count = transfer_count;
+    dma[channel].busy = false;
+    if(trigger) dma_trigger(channel);
+}
+
+void dma_channel_start(uint channel) {
+    run_to_now();
+    dma_trigger(channel);
+}
+
+// Memory-to-memory transfers happen all at once; ADC- and SPI-paced ones take as long as the
+// conversions or words
+void dma_channel_wait_for_finish_blocking(uint channel) {
+    bool from_adc = dma[channel].config.dreq == DREQ_ADC && dma[channel].read_addr == &adc_hw->fifo;
+    bool to_spi = spi_for_dreq(dma[channel].config.dreq) != NULL;
+
+    while(dma[channel].busy) {
+        if(to_spi) {
+            run_until(spi_next_time());
+        } else if(!from_adc) {
+            uint32_t word = 0;
+            memcpy(&word, (const void *) dma[channel].read_addr, 1u << dma[channel].config.size);
+            dma_transfer(channel, word);
+        } else if(!adc.running) {
+            fprintf(stderr, "sim: DMA paced by DREQ_ADC while the ADC is stopped\n");
+            abort();
+        } else {
+            run_until(adc_next_time());
+        }
+    }
+}
+
+void dma_channel_cleanup(uint channel) {
+    dma_channel_abort(channel);
+    dma[channel].irq0_enabled = false;
+    dma_ints0 &= ~(1u << channel);
+}
+
+void dma_channel_abort(uint channel) {
+    run_to_now();
+    dma[channel].busy = false;
+}
+
+bool dma_channel_is_busy(uint channel) {
+    run_to_now();
+    return dma[channel].busy;
+}
+
+void dma_channel_set_write_addr(uint channel, volatile void *write_addr, bool trigger) {
+    dma[channel].write_addr = write_addr;
+    if(trigger) dma_trigger(channel);
+}
+
+void dma_channel_set_read_addr(uint channel, const volatile void *read_addr, bool trigger) {
+    dma[channel].read_addr = read_addr;
+    if(trigger) dma_trigger(channel);
+}
+
+void dma_channel_set_trans_count(uint channel, uint32_t trans_count, bool trigger) {
+    dma[channel].reload_count = trans_count;
+    if(trigger) dma_trigger(channel);
+}
+
+void dma_channel_set_irq0_enabled(uint channel, bool enabled) {
+    dma[channel].irq0_enabled = enabled;
+}
+
+bool dma_channel_get_irq0_status(uint channel) {
+    return dma_ints0 & (1u << channel);
+}
+
+void dma_channel_acknowledge_irq0(uint channel) {
+    dma_ints0 &= ~(1u << channel);
+}
+
+
+/*************** INTERRUPTS ***************/
+
+void irq_set_exclusive_handler(uint num, irq_handler_t handler) {
+    if(num == DMA_IRQ_0) dma_irq0_handler = handler;
+}
+
+void irq_set_enabled(uint num, bool enabled) {
+    if(num == DMA_IRQ_0) dma_irq0_enabled = enabled;
+    dma_irq_check();
+}
+
+uint32_t save_and_disable_interrupts(void) {
+    uint32_t status = irqs_masked;
+    irqs_masked = true;
+    return status;
+}
+
+void restore_interrupts(uint32_t status) {
+    irqs_masked = status;
+    dma_irq_check();
+}
+
+// Runs the model until an interrupt is taken
+static void run_until_irq(const char *caller) {
+    irq_taken = false;
+    while(!irq_taken) {
+        if(!adc.running || adc_dma_channel() < 0 || irqs_masked) {
+            fprintf(stderr, "sim: %s() with no interrupt to wait for\n", caller);
+            abort();
+        }
+        run_until(adc_next_time());
+    }
+}
+
+void __wfi(void) {
+    run_until_irq("__wfi");
+}
+
+// The only events are the ones sent by interrupt handlers
+void __wfe(void) {
+    run_until_irq("__wfe");
+}
@@ -0,0 +1,235 @@
+// Host-side simulation of the full measurement chain.
+// Runs the same calibration and measurement sequence as main.c against the synthetic
+// front end in sim_hw.c, then checks the corrected sweep against the DUT's actual Gamma.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include "vna.h"
+#include "vnasweeps.h"
+#include "sim.h"
+
+// Same averaging as main.c
+static const uint meas_avgs = 1;
+static const uint cal_avgs = 1;
+
+// Largest acceptable |Gamma_cald - Gamma_actual| over the sweep: about five times what the sim
+// reaches with the DFT and per-sample estimators, and twice the cross-spectrum one's
+#define MAX_GAMMA_ERROR 0.01
+#define MAX_GAMMA_ERROR_CROSS 0.04
+
+// Segmented sweep for -m segmented: dense through the DUT's resonance, log either side
+static const vna_sweep_segment_t sim_segments[] = {
+  {250, 2500, 10, true},
+  {2500, 5000, 30, false},
+  {5000, 12500, 10, true}
+};
+
+// Standards for -k: homemade ones on the end of a short lead, with a 51 ohm load, roughly as
+// characterized at the bench
+static const vna_cal_kit_t sim_cal_kit = {
+  {150.0, 2.0, 50.0}, 8000.0, 0, 0, 0,     // Short: lead inductance
+  {150.0, 2.0, 50.0}, 3000.0, 0, 0, 0,     // Open: stray capacitance
+  {150.0, 2.0, 50.0}, 51.0                 // Load
+};
+
+// Host monotonic time in us
+static double host_time_us() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+// Sweeps into gammas and info, reporting host and simulated time taken
+static void timed_sweep(vna_meas_t meas, double_cplx_t *gammas, vna_point_info_t *info, uint8_t numavgs, const char *label) {
+  double host_start = host_time_us();
+  uint64_t sim_start = time_us_64();
+  vna_sweep_freq(meas, gammas, info, numavgs);
+  printf("%-8s sweep: %10.1f us host, %10.1f ms simulated\n", label,
+    host_time_us() - host_start, (time_us_64() - sim_start) / 1000.0);
+
+  vna_sweep_stats_t stats = vna_sweep_get_stats();
+  printf("         stages (ms): retune %.1f, settle %.1f, capture %.1f, dsp %.1f (%.1f overlapped)\n",
+    stats.stages.retune_us / 1000.0, stats.stages.settle_us / 1000.0, stats.stages.capture_us / 1000.0,
+    stats.stages.dsp_us / 1000.0, stats.stages.dsp_overlapped_us / 1000.0);
+  printf("         captures: %lu (%lu outliers)\n",
+    (unsigned long) stats.stages.captures, (unsigned long) stats.stages.outliers);
+}
+
+static void usage(const char *prog) {
+  printf("Usage: %s [-n num_points] [-s num_sweeps] [-e per_sample|cross|dft] [-c switched|simultaneous] [-m linear|log|segmented] [-a] [-g std_err -A max_avgs] [-k model|ignore] [-t] [-u] [-v]\n", prog);
+  printf("  -n  Number of points per sweep (default 50, as in main.c)\n");
+  printf("  -s  Number of measurement sweeps after calibration (default 1)\n");
+  printf("  -e  Gamma estimator (default dft)\n");
+  printf("  -c  Capture mode (default switched); simultaneous models a detector on each path\n");
+  printf("  -m  Point spacing (default log, as in main.c); segmented ignores -n\n");
+  printf("  -a  Start the ADC from the CPU after each phase restart instead of from the PIO\n");
+  printf("  -g  Stop averaging each point once the standard error of its gamma is below std_err\n");
+  printf("  -A  Captures per point in every sweep, at most with -g (default cal_avgs and meas_avgs, as in main.c)\n");
+  printf("  -k  Use characterized standards (sim_cal_kit) and calibrate with their model, or as if ideal\n");
+  printf("  -t  Print the settling time of each point\n");
+  printf("  -u  Unpipelined sweeps: finish the DSP of each point before moving on\n");
+  printf("  -v  Print the corrected sweep\n");
+}
+
+int main(int argc, char **argv) {
+  int num_points = 50;
+  int num_sweeps = 1;
+  bool verbose = false;
+  vna_gamma_estimator_t estimator = VNA_GAMMA_DFT;
+  vna_capture_mode_t capture_mode = VNA_CAPTURE_SWITCHED;
+  vna_sweep_mode_t sweep_mode = VNA_SWEEP_LOG;
+  bool settle_report = false;
+  bool pipelined = true;
+  bool synced_adc_start = true;
+  double avg_target = 0.0;
+  int max_avgs = 0;
+  const vna_cal_kit_t *actual_kit = NULL, *cal_kit = NULL;
+
+  for(int i = 1; i < argc; i++) {
+    if(!strcmp(argv[i], "-n") && i + 1 < argc) num_points = atoi(argv[++i]);
+    else if(!strcmp(argv[i], "-s") && i + 1 < argc) num_sweeps = atoi(argv[++i]);
+    else if(!strcmp(argv[i], "-e") && i + 1 < argc && !strcmp(argv[i+1], "per_sample")) {
+      estimator = VNA_GAMMA_PER_SAMPLE;
+      i++;
+    }
+    else if(!strcmp(argv[i], "-e") && i + 1 < argc && !strcmp(argv[i+1], "cross")) {
+      estimator = VNA_GAMMA_CROSS_SPECTRUM;
+      i++;
+    }
+    else if(!strcmp(argv[i], "-e") && i + 1 < argc && !strcmp(argv[i+1], "dft")) {
+      estimator = VNA_GAMMA_DFT;
+      i++;
+    }
+    else if(!strcmp(argv[i], "-c") && i + 1 < argc && !strcmp(argv[i+1], "switched")) {
+      capture_mode = VNA_CAPTURE_SWITCHED;
+      i++;
+    }
+    else if(!strcmp(argv[i], "-c") && i + 1 < argc && !strcmp(argv[i+1], "simultaneous")) {
+      capture_mode = VNA_CAPTURE_SIMULTANEOUS;
+      i++;
+    }
+    else if(!strcmp(argv[i], "-m") && i + 1 < argc && !strcmp(argv[i+1], "linear")) {
+      sweep_mode = VNA_SWEEP_LINEAR;
+      i++;
+    }
+    else if(!strcmp(argv[i], "-m") && i + 1 < argc && !strcmp(argv[i+1], "log")) {
+      sweep_mode = VNA_SWEEP_LOG;
+      i++;
+    }
+    else if(!strcmp(argv[i], "-m") && i + 1 < argc && !strcmp(argv[i+1], "segmented")) {
+      sweep_mode = VNA_SWEEP_SEGMENTED;
+      i++;
+    }
+    else if(!strcmp(argv[i], "-a")) synced_adc_start = false;
+    else if(!strcmp(argv[i], "-g") && i + 1 < argc) avg_target = atof(argv[++i]);
+    else if(!strcmp(argv[i], "-A") && i + 1 < argc) max_avgs = atoi(argv[++i]);
+    else if(!strcmp(argv[i], "-k") && i + 1 < argc && !strcmp(argv[i+1], "model")) {
+      actual_kit = cal_kit = &sim_cal_kit;
+      i++;
+    }
+    else if(!strcmp(argv[i], "-k") && i + 1 < argc && !strcmp(argv[i+1], "ignore")) {
+      actual_kit = &sim_cal_kit;
+      i++;
+    }
+    else if(!strcmp(argv[i], "-t")) settle_report = true;
+    else if(!strcmp(argv[i], "-u")) pipelined = false;
+    else if(!strcmp(argv[i], "-v")) verbose = true;
+    else {
+      usage(argv[0]);
+      return 2;
+    }
+  }
+
+  sim_config_t config = sim_default_config();
+  config.dual_detector = capture_mode == VNA_CAPTURE_SIMULTANEOUS;
+  config.cal_kit = actual_kit;
+  sim_init(&config);
+  vna_init();
+  vna_set_gamma_estimator(estimator);
+
+  // Same setup as main.c
+  vna_meas_setup_t meas_setup = {
+    // Start (kHz)
+    (double) 250,
+    // End (kHz)
+    (double) 12500,
+    // Num Points
+    (uint) num_points,
+    // Spacing
+    sweep_mode,
+    sim_segments,
+    sizeof(sim_segments)/sizeof(sim_segments[0]),
+    NULL,
+    cal_kit
+  };
+  if(!vna_sweep_setup_valid(&meas_setup)) {
+    printf("Invalid sweep setup\n");
+    return 2;
+  }
+  vna_meas_t measurement = vna_meas_init(&meas_setup);
+  if(!measurement.arena) {
+    printf("Out of memory for %u points\n", vna_sweep_num_points(&meas_setup));
+    return 2;
+  }
+
+  vna_set_capture_mode(capture_mode);
+  vna_set_synced_adc_start(synced_adc_start);
+  vna_set_avg_target(avg_target);
+  uint8_t sweep_cal_avgs = max_avgs > 0 ? max_avgs : cal_avgs;
+  uint8_t sweep_meas_avgs = max_avgs > 0 ? max_avgs : meas_avgs;
+  vna_sweep_set_settle_report(settle_report);
+  vna_sweep_set_pipelined(pipelined);
+
+  // Calibrate
+  sim_set_dut((sim_dut_t) {SIM_DUT_SHORT});
+  timed_sweep(measurement, measurement.cal_short, NULL, sweep_cal_avgs, "short");
+  sim_set_dut((sim_dut_t) {SIM_DUT_OPEN});
+  timed_sweep(measurement, measurement.cal_open, NULL, sweep_cal_avgs, "open");
+  sim_set_dut((sim_dut_t) {SIM_DUT_LOAD});
+  timed_sweep(measurement, measurement.cal_load, NULL, sweep_cal_avgs, "load");
+
+  double host_start = host_time_us();
+  vna_run_cal(measurement);
+  printf("cal math:       %10.1f us host\n", host_time_us() - host_start);
+
+  // Measure a series RLC, resonant around 3.4MHz
+  sim_set_dut((sim_dut_t) {SIM_DUT_RLC, 33.0, 2.2e-6, 1e-9});
+  for(int s = 0; s < num_sweeps; s++) {
+    timed_sweep(measurement, measurement.gammas_uncald, measurement.point_info, sweep_meas_avgs, "dut");
+    host_start = host_time_us();
+    vna_run_correction(measurement);
+    printf("correction:     %10.1f us host\n", host_time_us() - host_start);
+  }
+
+  // Compare against the actual DUT
+  double max_err = 0.0;
+  double max_std_err = 0.0;
+  for(int i = 0; i < measurement.plan.num_points; i++) {
+    double_cplx_t pt = measurement.gammas_cald[i];
+    double_cplx_t actual = sim_dut_gamma(measurement.frequencies[i]);
+    double err = cplx_mag(cplx_sub(pt, actual));
+    if(err > max_err) max_err = err;
+
+    // Standard error of the point's mean, from the noise carried through the correction
+    vna_point_info_t info = measurement.point_info_cald[i];
+    double std_err = sqrt(info.variance / info.count);
+    if(std_err > max_std_err) max_std_err = std_err;
+    if(verbose) {
+      printf("@%8.1fkHz  \tΓ = %f ∠ %8.3fdeg  \tactual %f ∠ %8.3fdeg  \t|err| = %f  \tn = %u, σ = %f%s\n",
+        measurement.frequencies[i], cplx_mag(pt), cplx_ang_deg(pt),
+        cplx_mag(actual), cplx_ang_deg(actual), err, info.count, std_err,
+        info.settle.timeouts ? " (settling timed out)" : "");
+    }
+  }
+  if(max_std_err > 0.0) printf("max σ(Γ) = %f\n", max_std_err);
+  double max_gamma_error = estimator == VNA_GAMMA_CROSS_SPECTRUM ? MAX_GAMMA_ERROR_CROSS : MAX_GAMMA_ERROR;
+  printf("max |Γ error| = %f (limit %f)\n", max_err, max_gamma_error);
+  uint32_t early_starts = sim_early_adc_starts();
+  if(early_starts) printf("ADC started before the phase restart %u times\n", (unsigned) early_starts);
+
+  vna_meas_deinit(&measurement);
+  return max_err <= max_gamma_error && !early_starts ? 0 : 1;
+}
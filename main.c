@@ -18,7 +18,7 @@
 
 // Number of measurements to average together, discarding one outlier
 const uint meas_avgs = 1;  // For normal measurements
-const uint cal_avgs = 2;   // For initial calibration
+const uint cal_avgs = 1;   // For initial calibration (the synced ADC start makes repeats unnecessary)
 
 // Number of points in a measurement
 #define num_points 50
@@ -29,7 +29,8 @@ const uint cal_avgs = 2;   // For initial calibration
 // Stores the setup of the measurement
 vna_meas_setup_t measurement_setup;
 
-// Stores the data from calibration and measurement
+// Stores the data from calibration and measurement, in storage sized for num_points at build time
+VNA_MEAS_STATIC_STORAGE(measurement_storage, num_points);
 vna_meas_t measurement_data;
 
 // Stores the data that actually get graphed
@@ -92,11 +93,15 @@ void init_vna() {
         // End (kHz)
         (double) 12500,
         // Num Points
-        (uint) num_points
+        (uint) num_points,
+        // Log spacing, to match the graph's log frequency axis
+        VNA_SWEEP_LOG
     };
 
     // Initialize measurement data arrays
-    measurement_data = vna_meas_init(&measurement_setup);
+    measurement_data = vna_meas_init_in(&measurement_setup, measurement_storage, sizeof(measurement_storage));
+    if(!vna_sweep_setup_valid(&measurement_setup)) panic("Invalid sweep setup");
+    if(!measurement_data.arena) panic("measurement_storage too small for %d points", num_points);
     
     // Copy pointer to frequencies array
     graph_frequencies = measurement_data.frequencies;
@@ -117,7 +122,7 @@ void calibration_routine() {
 
     sleep_ms(100);
     ili9341_drawString(&tft, 100, 150, "Loading...", 0xFFFF, 0x0000, 1);
-    vna_sweep_freq(measurement_data, measurement_data.cal_short, cal_avgs);
+    vna_sweep_freq(measurement_data, measurement_data.cal_short, NULL, cal_avgs);
     ili9341_box(&tft, 150, 100, 100, 100, 0x0000);
 
     // UI: Ask the user to connect a OPEN
@@ -131,7 +136,7 @@ void calibration_routine() {
 
     sleep_ms(100);
     ili9341_drawString(&tft, 100, 150, "Loading...", 0xFFFF, 0x0000, 1);
-    vna_sweep_freq(measurement_data, measurement_data.cal_open, cal_avgs);
+    vna_sweep_freq(measurement_data, measurement_data.cal_open, NULL, cal_avgs);
     ili9341_box(&tft, 150, 100, 100, 100, 0x0000);
 
 
@@ -144,7 +149,7 @@ void calibration_routine() {
         }
     }
     ili9341_drawString(&tft, 100, 150, "Loading...", 0xFFFF, 0x0000, 1);
-    vna_sweep_freq(measurement_data, measurement_data.cal_load, cal_avgs);
+    vna_sweep_freq(measurement_data, measurement_data.cal_load, NULL, cal_avgs);
 
     // Do calibration 3-term error model maths
     vna_run_cal(measurement_data);
@@ -153,7 +158,7 @@ void calibration_routine() {
 // Takes a measurement
 void take_measurement() {
     // Take measurement and put it in the measurement_data arrays
-    vna_sweep_freq(measurement_data, measurement_data.gammas_uncald, meas_avgs);
+    vna_sweep_freq(measurement_data, measurement_data.gammas_uncald, measurement_data.point_info, meas_avgs);
 
     // Apply calibration
     vna_run_correction(measurement_data);
@@ -13,9 +13,45 @@ void pio_set_sq_freq(PIO pio, uint sm_id, float freq) {
       pio_sm_set_clkdiv(pio, sm_id, (uint) (PICO_CLK / freq / 2) );
 }
 
+// Where the LO and source reset programs were loaded, for restarts
+static uint losq_offset;
+static uint srcreset_offset;
+
 void pio_init_losq(PIO pio, uint sm_id, uint s0, uint s1) {
     uint offset = pio_add_program(pio, &losquare_program);
+    losq_offset = offset;
     losquare_init(pio, sm_id, offset, s0);
+    pio_sm_exec(pio, sm_id, pio_encode_jmp(offset + 1));  // Run free until the first synchronized restart
+}
+
+void pio_init_srcreset(PIO pio, uint sm_id, uint reset_pin) {
+    srcreset_offset = pio_add_program(pio, &srcreset_program);
+    srcreset_init(pio, sm_id, srcreset_offset, reset_pin, SRCRESET_CLKDIV);
+}
+
+void pio_stop_losq_sync(PIO pio, uint lo_sm, uint rst_sm) {
+    uint32_t mask = (1u << lo_sm) | (1u << rst_sm);
+    pio_set_sm_mask_enabled(pio, mask, false);
+    pio_interrupt_clear(pio, LOSQ_SYNC_IRQ);
+    // The word pushed by the last release holds the RX DREQ high until it is cleared; from here it
+    // stays low until pio_release_losq_sync
+    pio_sm_clear_fifos(pio, rst_sm);
+
+    // Both back to the start of their programs
+    pio_sm_restart(pio, lo_sm);
+    pio_sm_restart(pio, rst_sm);
+    pio_sm_exec(pio, lo_sm, pio_encode_jmp(losq_offset));
+    pio_sm_exec(pio, rst_sm, pio_encode_jmp(srcreset_offset));
+}
+
+void pio_release_losq_sync(PIO pio, uint lo_sm, uint rst_sm) {
+    // One register write starts both, with their clock dividers in phase
+    pio_enable_sm_mask_in_sync(pio, (1u << lo_sm) | (1u << rst_sm));
+}
+
+void pio_restart_losq_sync(PIO pio, uint lo_sm, uint rst_sm) {
+    pio_stop_losq_sync(pio, lo_sm, rst_sm);
+    pio_release_losq_sync(pio, lo_sm, rst_sm);
 }
 
 float pio_set_losq_freq(PIO pio, uint sm_id, float freq) {
@@ -23,7 +59,11 @@ float pio_set_losq_freq(PIO pio, uint sm_id, float freq) {
     uint32_t div_int;
     uint8_t div_frac8;
     pio_calculate_clkdiv8_from_float(div, &div_int, &div_frac8);
-    pio_sm_set_clkdiv_int_frac(pio, sm_id, div_int, 0);
+    pio_set_losq_clkdiv(pio, sm_id, div_int, div_frac8);
+
+    return (float) pio_losq_freq(div_int, div_frac8);
+}
 
-    return ((float) PICO_CLK) / (((float) div_int) + ((float) 0)/256) / 4;
+void pio_set_losq_clkdiv(PIO pio, uint sm_id, uint32_t div_int, uint8_t div_frac8) {
+    pio_sm_set_clkdiv_int_frac(pio, sm_id, div_int, div_frac8);
 }
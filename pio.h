@@ -16,8 +16,34 @@ void pio_set_sq_freq(PIO pio, uint sm_id, float freq);
 void pio_init_losq(PIO pio, uint sm_id, uint s0, uint s1);
 float pio_set_losq_freq(PIO pio, uint sm_id, float freq);
 
+// Sets the LO clock divider directly, in whole and 1/256 PIO clocks.
+// Fractional dividers are dithered by the PIO, so the LO edges jitter by one system clock.
+void pio_set_losq_clkdiv(PIO pio, uint sm_id, uint32_t div_int, uint8_t div_frac8);
+
+// LO frequency (kHz, as pio_set_losq_freq) that a clock divider gives
+static inline double pio_losq_freq(uint32_t div_int, uint8_t div_frac8) {
+    return ((double) PICO_CLK) / (div_int + div_frac8 / 256.0) / 4;
+}
+
+// Clock divider for srcreset, making its reset pulse about 2us
+#define SRCRESET_CLKDIV 10.0f
+
+// Initializes the source reset program (srcreset in losquare.pio) on a state machine in the same
+// PIO as the LO, driving the source's RESET pin
+void pio_init_srcreset(PIO pio, uint sm_id, uint reset_pin);
+
+// Restarts the LO on lo_sm and pulses the source's reset from rst_sm, started by a single register
+// write: the LO waits for the source to leave reset, so the two restart a fixed number of system
+// clocks apart. Nothing here is timed by the CPU, so interrupts can stay on.
+void pio_restart_losq_sync(PIO pio, uint lo_sm, uint rst_sm);
+// The two halves of pio_restart_losq_sync: stopping both state machines at the start of their
+// programs and emptying rst_sm's FIFOs, then releasing them. Anything paced by rst_sm's RX DREQ
+// must be armed in between, as the DREQ is only low from the stop until the release.
+void pio_stop_losq_sync(PIO pio, uint lo_sm, uint rst_sm);
+void pio_release_losq_sync(PIO pio, uint lo_sm, uint rst_sm);
+
 // Resets phase of LO square wave
-inline void pio_reset_losq(PIO pio, uint sm_id) {
+static inline void pio_reset_losq(PIO pio, uint sm_id) {
     pio_sm_set_enabled(pio, sm_id, false);
     pio_sm_clkdiv_restart(pio, sm_id);
     pio_sm_set_enabled(pio, sm_id, true);
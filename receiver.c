@@ -21,6 +21,11 @@ void rx_init() {
     pio_set_losq_freq(TAYLOE_PIO, 0, 1000);  // 1kHz resting
 }
 
+// Hands the source's reset pin to the LO's PIO, for rx_restart_phase_sync
+void rx_init_phase_sync(uint src_reset_pin) {
+    pio_init_srcreset(TAYLOE_PIO, RX_SYNC_SM, src_reset_pin);
+}
+
 // Sets the frequency of the LO.
 // The actual LO frequency will be four times the value specified to this function,
 // since the Tayloe detector requires it, but the specified frequency will be the
@@ -29,6 +34,11 @@ float rx_setfreq(unsigned long int freq) {
     return (float) pio_set_losq_freq(TAYLOE_PIO, 0, freq);
 }
 
+// Sets the LO clock divider directly, as from vna_plan_freq
+void rx_set_lo_clkdiv(uint32_t div_int, uint8_t div_frac8) {
+    pio_set_losq_clkdiv(TAYLOE_PIO, 0, div_int, div_frac8);
+}
+
 // Configure the receiver to receive the incident signal
 void rx_set_incident() {
     gpio_put(RX_REFL_EN, true);
@@ -39,4 +49,10 @@ void rx_set_incident() {
 void rx_set_reflected() {
     gpio_put(RX_REFL_EN, false);
     gpio_put(RX_INCT_EN, true);
+}
+
+// Configure the receiver to receive the incident and reflected signals at once
+void rx_set_both() {
+    gpio_put(RX_REFL_EN, false);
+    gpio_put(RX_INCT_EN, false);
 }
\ No newline at end of file
@@ -18,6 +18,8 @@
 
 // Internal PIO to use for the Tayloe LO
 #define TAYLOE_PIO pio1
+// State machine in TAYLOE_PIO that pulses the source's reset for synchronized restarts
+#define RX_SYNC_SM 1
 
 // Initializes the receiver and puts everything into a reset state
 void rx_init();
@@ -29,15 +31,46 @@ void rx_init();
 // Returns actual frequency
 float rx_setfreq(unsigned long int freq);
 
+// Sets the LO clock divider directly, in whole and 1/256 PIO clocks (see pio_losq_freq)
+void rx_set_lo_clkdiv(uint32_t div_int, uint8_t div_frac8);
+
 // Configure the receiver to receive the incident signal
 void rx_set_incident();
 
 // Configure the receiver to receive the reflected signal
 void rx_set_reflected();
 
+// Configure the receiver to receive the incident and reflected signals at once.
+// Only meaningful with a detector on each path (reflected I/Q on ADC_RFL_I/ADC_RFL_Q),
+// as used by take_dual_iq_samples; a single shared detector would see their sum.
+void rx_set_both();
+
 // Resets the phase of the LO to a consistent value
-inline void rx_reset_phase(){
+static inline void rx_reset_phase(){
     pio_reset_losq(TAYLOE_PIO, 0);
 }
 
+// Hands the source's reset pin to the LO's PIO, for rx_restart_phase_sync
+void rx_init_phase_sync(uint src_reset_pin);
+
+// Restarts the source (through its reset pin) and the LO together, timed by the PIO rather than
+// the CPU, so interrupts can stay enabled
+static inline void rx_restart_phase_sync() {
+    pio_restart_losq_sync(TAYLOE_PIO, 0, RX_SYNC_SM);
+}
+
+// rx_restart_phase_sync in two steps, to arm a DMA channel paced by rx_phase_sync_dreq in between
+static inline void rx_stop_phase_sync() {
+    pio_stop_losq_sync(TAYLOE_PIO, 0, RX_SYNC_SM);
+}
+static inline void rx_release_phase_sync() {
+    pio_release_losq_sync(TAYLOE_PIO, 0, RX_SYNC_SM);
+}
+
+// DREQ raised by rx_restart_phase_sync as the source and LO restart, for starting the ADC with them.
+// It stays raised until the next rx_stop_phase_sync.
+static inline uint rx_phase_sync_dreq() {
+    return pio_get_dreq(TAYLOE_PIO, RX_SYNC_SM, false);
+}
+
 #endif
@@ -10,6 +10,7 @@
 #include <math.h>
 #include "vna.h"
 #include "vnasweeps.h"
+#include "vnabench.h"
 
 #define LED_BUILTIN 25
 
@@ -94,11 +95,11 @@ static void test_rx_adc() {
   printf("\t%f+j%f\n\r", load_meas.a, load_meas.b);
 
   printf("Calibrating...\r");
-  error_terms_t error_terms = vna_cal_point(short_meas, open_meas, load_meas);
+  error_terms_t error_terms = vna_cal_point(short_meas, open_meas, load_meas, VNA_CAL_STANDARDS_IDEAL);
   printf("Calibrated.          \n\r\n\r");
 
 
-    error_terms_t err = vna_cal_point(short_meas, open_meas, load_meas);
+    error_terms_t err = vna_cal_point(short_meas, open_meas, load_meas, VNA_CAL_STANDARDS_IDEAL);
 
   double_cplx_t cal_short = vna_apply_cal_point(short_meas, err);
   double_cplx_t cal_open  = vna_apply_cal_point(open_meas,  err);
@@ -146,21 +147,22 @@ static void test_vnasweeps() {
   printf("Levels at ~12MHz: %f%% ref,  \t%f%% refl  \n\r", 100*vna_ref_levelcheck(12000), 100*vna_refl_levelcheck(12000));
   
   vna_meas_t measurement = vna_meas_init(&meas_setup);
+  if(!measurement.arena) panic("Out of memory for the measurement arrays");
 
   printf("Set short and press enter.\n\r");
   getchar();
 
-  vna_sweep_freq(measurement, measurement.cal_short, cal_avgs);
+  vna_sweep_freq(measurement, measurement.cal_short, NULL, cal_avgs);
 
   printf("Set open and press enter.\n\r");
   getchar();
 
-  vna_sweep_freq(measurement, measurement.cal_open, cal_avgs);
+  vna_sweep_freq(measurement, measurement.cal_open, NULL, cal_avgs);
 
   printf("Set load and press enter.\n\r");
   getchar();
 
-  vna_sweep_freq(measurement, measurement.cal_load, cal_avgs);
+  vna_sweep_freq(measurement, measurement.cal_load, NULL, cal_avgs);
 
   printf("Calculating errr terms...\r");
   vna_run_cal(measurement);
@@ -172,7 +174,7 @@ static void test_vnasweeps() {
 
   while(1) {
     // Take measurement
-    vna_sweep_freq(measurement, measurement.gammas_uncald, meas_avgs);
+    vna_sweep_freq(measurement, measurement.gammas_uncald, measurement.point_info, meas_avgs);
 
     // Apply correction
     vna_run_correction(measurement);
@@ -188,6 +190,20 @@ static void test_vnasweeps() {
   }
 }
 
+static uint64_t bench_time_ns() {
+  return time_us_64() * 1000;
+}
+
+static void test_benchmarks() {
+  getchar();
+  vna_bench_timer_t timer = {
+    bench_time_ns,
+    NULL,  // Derived from the time at clk_sys
+    (double) clock_get_hz(clk_sys)
+  };
+  vna_bench_run("rp2040", &timer, 200);
+}
+
 void main() {
   stdio_init_all();
   sleep_ms(1000);
@@ -195,8 +211,11 @@ void main() {
   // test_rx();
   // test_piofreq();
   // test_rx_adc();
-
+#ifdef SUPERVNA_BENCH
+  test_benchmarks();  // The SuperVNA_bench firmware
+#else
   test_vnasweeps();
+#endif
 
   // pio_init_losq(pio0, 1, 0, 1);
   // pio_set_losq_freq(pio0, 1, 1000);
@@ -3,16 +3,56 @@
 #include "vna.h"
 #include "receiver.h"
 #include "adc_sampling.h"
+#include "adc_stream.h"
 #include <pico/stdlib.h>
 #include "ad9834.h"
 #include <stdio.h>
+#include <math.h>
 #include "complex_math.h"
 #include <pico/sync.h>
 
-static double ref_I[NUM_SAMPLES];
-static double ref_Q[NUM_SAMPLES];
-static double rfl_I[NUM_SAMPLES];
-static double rfl_Q[NUM_SAMPLES];
+// Estimator used by vna_calc_gamma_raw
+static vna_gamma_estimator_t gamma_estimator = VNA_GAMMA_DFT;
+
+// How points are captured
+static vna_capture_mode_t capture_mode = VNA_CAPTURE_SWITCHED;
+
+// Whether the ADC stream of each point is started by the PIO restart (vna_set_synced_adc_start)
+static bool synced_adc_start = true;
+
+// Offset of the current point's IF from ADC_INPUT_FREQ, in kHz (to the AD9834's resolution), which
+// turns the reflected capture against the incident one by however long the switch took to settle
+static double if_offset;
+
+// Settling of the current point
+static vna_settle_info_t last_settle;
+
+// Point from vna_stage_freq_plan, until vna_commit_freq, and whether it is still loaded into the
+// AD9834's idle register
+static vna_freq_plan_t staged_plan;
+static bool staged_pending = false;
+static bool staged = false;
+
+// The most recent capture, waiting for its DSP stage (see vna_meas_point_start)
+static uint16_t raw_ref[NUM_DUAL_SAMPLES];  // Incident capture, or a whole dual capture
+static uint16_t raw_rfl[NUM_SAMPLES];       // Reflected capture, in switched mode
+
+// The point the pending capture belongs to
+static struct {
+    bool raw_pending;           // raw_ref/raw_rfl hold a capture not processed yet
+    vna_capture_mode_t mode;    // How it was captured
+    double rfl_turns;           // Turns of if_offset between the incident and reflected captures
+    double_cplx_t *dest;        // Where the point's gamma goes
+    vna_point_info_t *info;     // and its noise, if anywhere
+    int num_avgs;
+    int num_done;               // Captures processed so far
+    vna_avg_t avg;              // Their raw gammas
+} pending;
+
+// Standard error at which points stop averaging (vna_set_avg_target), 0 for none
+static double avg_target = 0.0;
+
+static vna_stage_times_t stage_times;
 
 // Initializes all VNA hardware
 void vna_init() {
@@ -20,36 +60,121 @@ void vna_init() {
   rx_init();        // Initialize the receiver
   rx_adc_init();    // Initialize the ADC
 
-  gpio_init(SRC_RESET);
-  gpio_set_dir(SRC_RESET, true);
+  rx_init_phase_sync(SRC_RESET);   // The source's reset is pulsed by the LO's PIO
 }
 
-// Sets LO as close as possible to a given frequency in kHz + ADC_FREQ
-// and sets the source appropriately to result in a proper ADC_FREQ.
-// Returns the actual source frequency.
-double vna_set_freq(uint16_t freq) {
-    // Set the receiver frequency
-    // This is what limits frequency resolution, due to integer division
-    uint16_t lofreq_real = (uint16_t)rx_setfreq(freq + RDG_ADC_FREQ);
+static void vna_run_dsp_stage(bool overlapped);
+
+// Reads blocks of the I/Q stream of the inputs in rr_mask until the receiver has settled (see
+// RDG_SETTLE_TOLERANCE) or timeout_us worth of blocks have passed. Returns the time taken in us,
+// counted in blocks of the stream so it doesn't depend on how long the CPU took.
+// Any capture waiting for its DSP stage is processed first, while the receiver settles.
+static uint32_t vna_wait_settled(uint32_t rr_mask, uint32_t timeout_us) {
+    int num_paths = rr_mask == ADC_DUAL_RR_MASK ? 2 : 1;
+    double levels[2], last_levels[2] = {0};
+    uint32_t max_blocks = timeout_us / RX_BLOCK_US(rr_mask);
+    uint64_t t_start = time_us_64();
+    uint64_t dsp_start = stage_times.dsp_us;
+
+    rx_adc_stream_iq(rr_mask);
+    uint32_t start = adc_stream_position();
+    vna_run_dsp_stage(true);
+
+    bool settled = false;
+    for(int n = 0; !settled && adc_stream_position() - start < max_blocks; n++) {
+        rx_adc_burst_levels(rr_mask, levels);
+
+        settled = n > 0;
+        double threshold = RDG_SETTLE_TOLERANCE * fmax(levels[0], RDG_SETTLE_MIN_COUNTS);
+        for(int p = 0; p < num_paths; p++) {
+            if(fabs(levels[p] - last_levels[p]) > threshold) settled = false;
+            last_levels[p] = levels[p];
+        }
+    }
 
-    // Set the source frequency so as to result in a proper adc frequency
-    uint16_t srcfreq_real = lofreq_real + RDG_ADC_FREQ;
-    ad9834_setfreq(srcfreq_real*1000);
+    if(!settled) last_settle.timeouts++;
+    stage_times.settle_us += time_us_64() - t_start - (stage_times.dsp_us - dsp_start);
+    return (adc_stream_position() - start) * RX_BLOCK_US(rr_mask);
+}
+
+// Plans the LO divider and source tuning word for a source frequency in kHz
+vna_freq_plan_t vna_plan_freq(double freq) {
+    vna_freq_plan_t plan;
+
+    // The LO is the coarse one, so pick its divider first: nearest in 1/256ths of a PIO clock
+    double lo_target = freq - RDG_ADC_FREQ;
+    long div8 = lo_target > 0 ? lround(PICO_CLK * 256.0 / 4 / lo_target) : VNA_LO_DIV8_MAX;
+    if(div8 < VNA_LO_DIV8_MIN) div8 = VNA_LO_DIV8_MIN;
+    if(div8 > VNA_LO_DIV8_MAX) div8 = VNA_LO_DIV8_MAX;
+    plan.lo_div_int = div8 >> 8;
+    plan.lo_div_frac8 = div8 & 0xFF;
+    plan.lo_freq = pio_losq_freq(plan.lo_div_int, plan.lo_div_frac8);
+
+    // Then put the source a proper ADC_FREQ above the LO it actually gets
+    uint32_t src_word = ad9834_freq_word((plan.lo_freq + RDG_ADC_FREQ) * 1000);
+    plan.src_lsw = AD9834_FREQ_LSW(src_word);
+    plan.src_msw = AD9834_FREQ_MSW(src_word);
+    plan.src_freq = ad9834_word_freq(src_word) / 1000;
+    return plan;
+}
 
-    // printf("\n\r#SetFreq to %d\n\r", srcfreq_real);
+// Finishes a retune started at t_start: waits for steady-state and returns the actual source frequency
+static double vna_finish_retune(const vna_freq_plan_t *plan, uint64_t t_start) {
+    stage_times.retune_us += time_us_64() - t_start;
+    if_offset = plan->src_freq - plan->lo_freq - ADC_INPUT_FREQ;
 
-    // Sleep to wait for steady-state
-    sleep_ms(RDG_FREQCHANGE_DELAY_MS);
+    // Wait for steady-state
+    last_settle = (vna_settle_info_t) {0};
+    last_settle.freq_us = vna_wait_settled(capture_mode == VNA_CAPTURE_SIMULTANEOUS ? ADC_DUAL_RR_MASK : ADC_RR_MASK,
+                                          RDG_SETTLE_TIMEOUT_US);
 
     // Return the actual frequency that the source is at
-    return srcfreq_real;
+    return plan->src_freq;
+}
+
+// Writes a planned frequency point and waits for steady-state.
+// Returns the actual source frequency.
+double vna_set_freq_plan(const vna_freq_plan_t *plan) {
+    uint64_t t_start = time_us_64();
+    staged = false;     // The write below lands in the idle register
+    rx_set_lo_clkdiv(plan->lo_div_int, plan->lo_div_frac8);
+    ad9834_setfreq_halves(plan->src_lsw, plan->src_msw);
+    return vna_finish_retune(plan, t_start);
+}
+
+// Loads the source setting of the next point into the AD9834's idle register
+void vna_stage_freq_plan(const vna_freq_plan_t *plan) {
+    ad9834_preload_halves(plan->src_lsw, plan->src_msw);
+    staged_plan = *plan;
+    staged_pending = true;
+    staged = true;
+}
+
+// Switches to the staged point and waits for steady-state.
+// Returns the actual source frequency, or -1 if no point is staged.
+double vna_commit_freq() {
+    if(!staged_pending) return -1.0;
+    staged_pending = false;
+    if(!staged) return vna_set_freq_plan(&staged_plan);
+
+    uint64_t t_start = time_us_64();
+    rx_set_lo_clkdiv(staged_plan.lo_div_int, staged_plan.lo_div_frac8);
+    ad9834_select_preloaded();
+    staged = false;
+    return vna_finish_retune(&staged_plan, t_start);
+}
+
+// Sets the source as close as possible to a given frequency in kHz, with the LO
+// a proper ADC_FREQ below it. Returns the actual source frequency.
+double vna_set_freq(double freq) {
+    vna_freq_plan_t plan = vna_plan_freq(freq);
+    return vna_set_freq_plan(&plan);
 }
 
 // Checks the level of the reference signal, such that 1.0 is clipping the ADC
 double vna_ref_levelcheck(double freq) {
     rx_set_incident();
     vna_set_freq(freq);
-    sleep_ms(RDG_FREQCHANGE_DELAY_MS);
     return imax(
         rx_adc_get_pp_unfiltered_blocking(ADC_I),
         rx_adc_get_pp_unfiltered_blocking(ADC_Q)
@@ -60,82 +185,406 @@ double vna_ref_levelcheck(double freq) {
 double vna_refl_levelcheck(double freq) {
     rx_set_incident();
     vna_set_freq(freq);
-    sleep_ms(RDG_FREQCHANGE_DELAY_MS);
     return imax(
         rx_adc_get_pp_unfiltered_blocking(ADC_I),
         rx_adc_get_pp_unfiltered_blocking(ADC_Q)
     );
 }
 
-static double_cplx_t vna_meas_point_gamma_raw_once() {
-    // Measure incident power (vector)
-    uint32_t int_sav = save_and_disable_interrupts();  // Timing must be as constant as possible here for reduced phase noise in measurement
-    gpio_put(SRC_RESET, true);  // RESET PHASE
-    sleep_us(2);
-    gpio_put(SRC_RESET, false);  // Pull accumulator reset off so that we begin to have a source starting from a consistent phase
-    rx_reset_phase();
+// Restarts the source and LO from a consistent phase: the PIO pulses the source's reset and
+// releases the LO as the source leaves it, on its own clock. With synced_adc_start, the ADC stream
+// of the inputs in rr_mask is armed while they are stopped, so the restart starts it too.
+static void vna_reset_phase(uint32_t rr_mask) {
+    rx_stop_phase_sync();   // Also lowers the DREQ left raised by the last restart
+    if(synced_adc_start) rx_adc_stream_iq_on_dreq(rr_mask, rx_phase_sync_dreq());
+    rx_release_phase_sync();
+}
 
-    rx_set_incident();
-    sleep_us(50000);
-    take_interleaved_iq_samples(ref_I, ref_Q);
-
-    // Measure reflected power (vector)
-    // gpio_put(SRC_RESET, true);  // RESET PHASE
-    // sleep_us(2);
-    // gpio_put(SRC_RESET, false);
-    // rx_reset_phase();
-
-    rx_set_reflected();
-    sleep_us(50000);
-    take_interleaved_iq_samples(rfl_I, rfl_Q);
-    restore_interrupts(int_sav);
-    // gpio_put(SRC_RESET, true);  // Put source back in reset state
-
-    double_cplx_t total_gamma = cplx_zero;
-
-    for(int i = NUM_SAMPLES - NUM_SAMPLES_PROCESSED; i < NUM_SAMPLES; i++) { // For each (I,Q) pair
-        double_cplx_t ref = {ref_I[i], ref_Q[i]};
-        double_cplx_t rfl = {rfl_I[i], rfl_Q[i]};
-        total_gamma = cplx_add(total_gamma, cplx_div(    
-            rfl,
-            ref        
-        ));
+// Waits for the reflected path to settle after the switch in a switched capture, then as long again:
+// the detector stops once the change per block is small, which still leaves part of the step to
+// come, and the reflected capture is the one gamma is most sensitive to. Counted in stream blocks.
+static void vna_wait_switch_settled() {
+    uint32_t settle_us = vna_wait_settled(ADC_RR_MASK, RDG_SWITCH_SETTLE_US);
+    last_settle.path_us += settle_us;
+    uint32_t end = adc_stream_position() + settle_us / RX_BLOCK_US(ADC_RR_MASK);
+    uint64_t t_start = time_us_64();
+    while((int32_t)(end - adc_stream_position()) > 0) adc_stream_next_block(NULL);
+    stage_times.settle_us += time_us_64() - t_start;
+}
+
+// Reads the next capture of the inputs in rr_mask into samples
+static void vna_capture(uint32_t rr_mask, uint16_t *samples) {
+    uint64_t t_start = time_us_64();
+    rx_adc_capture_iq(rr_mask, samples);
+    stage_times.capture_us += time_us_64() - t_start;
+}
+
+// Takes one capture of the current point into raw_ref/raw_rfl, for the DSP stage
+static void vna_capture_point_once() {
+    // Timing must be as constant as possible here for reduced phase noise in measurement.
+    // The restart is timed by the PIO, and from there on the ADC stream keeps time, so nothing
+    // here depends on the CPU and interrupts stay on.
+    // With synced_adc_start the ADC stream is armed first and started by the restart itself, so
+    // every block of the point begins at the same source/LO phase.
+    uint64_t t_start = time_us_64();
+    uint32_t rr_mask = capture_mode == VNA_CAPTURE_SIMULTANEOUS ? ADC_DUAL_RR_MASK : ADC_RR_MASK;
+    vna_reset_phase(rr_mask);
+    stage_times.retune_us += time_us_64() - t_start;
+
+    if(capture_mode == VNA_CAPTURE_SIMULTANEOUS) {
+        // Measure incident and reflected power (vectors) together.
+        // The reflected samples trail the incident ones by two conversions, a fixed phase offset
+        // that calibration removes.
+        rx_set_both();
+        last_settle.path_us += vna_wait_settled(rr_mask, RDG_SETTLE_TIMEOUT_US);
+        vna_capture(rr_mask, raw_ref);
+    } else {
+        // Measure incident power (vector)
+        rx_set_incident();
+        last_settle.path_us += vna_wait_settled(ADC_RR_MASK, RDG_SETTLE_TIMEOUT_US);
+        vna_capture(ADC_RR_MASK, raw_ref);
+        uint32_t ref_end = adc_stream_position();
+
+        // Measure reflected power (vector)
+        // gpio_put(SRC_RESET, true);  // RESET PHASE
+        // sleep_us(2);
+        // gpio_put(SRC_RESET, false);
+        // rx_reset_phase();
+
+        rx_set_reflected();
+        vna_wait_switch_settled();
+        vna_capture(ADC_RR_MASK, raw_rfl);
+        // gpio_put(SRC_RESET, true);  // Put source back in reset state
+        pending.rfl_turns = if_offset * 1e-3 * (adc_stream_position() - ref_end) * RX_BLOCK_US(ADC_RR_MASK);
     }
 
-    return cplx_scale(total_gamma, 1.0/NUM_SAMPLES_PROCESSED);
+    pending.mode = capture_mode;
+    pending.raw_pending = true;
+    stage_times.captures++;
 }
 
-double_cplx_t vna_meas_point_gamma_raw(int num_avgs) {
-    // Take measurements
-    double_cplx_t points[num_avgs];
-    for(int i = 0; i < num_avgs; i++) {
-        points[i] = vna_meas_point_gamma_raw_once();
+// Empties a streaming average
+void vna_avg_reset(vna_avg_t *avg) {
+    *avg = (vna_avg_t) {0};
+}
+
+// Adds a gamma to a streaming average, unless it is an outlier
+bool vna_avg_add(vna_avg_t *avg, double_cplx_t gamma) {
+    double_cplx_t delta = cplx_sub(gamma, avg->mean);
+    double dist2 = delta.a*delta.a + delta.b*delta.b;
+
+    if(avg->count >= VNA_AVG_REJECT_MIN_COUNT &&
+       dist2 > VNA_AVG_OUTLIER_SIGMAS*VNA_AVG_OUTLIER_SIGMAS * vna_avg_variance(avg)) {
+        avg->rejected++;
+        return false;
     }
 
-    // Find mean
-    double_cplx_t sum = {0.0, 0.0};
-    for(int i = 0; i < num_avgs; i++) {
-        sum = cplx_add(sum, points[i]);
+    // Welford's update. For complex values m2 accumulates Re(delta * conj(delta2)), deltas from the
+    // means before and after, which sums |gamma - mean|^2.
+    avg->count++;
+    avg->mean = cplx_add(avg->mean, cplx_scale(delta, 1.0/avg->count));
+    double_cplx_t delta2 = cplx_sub(gamma, avg->mean);
+    avg->m2 += delta.a*delta2.a + delta.b*delta2.b;
+    return true;
+}
+
+// Sample variance of a streaming average
+double vna_avg_variance(const vna_avg_t *avg) {
+    return avg->count > 1 ? fmax(avg->m2 / (avg->count - 1), VNA_AVG_MIN_VARIANCE) : 0.0;
+}
+
+// Standard error of the mean of a streaming average
+double vna_avg_std_err(const vna_avg_t *avg) {
+    return avg->count > 1 ? sqrt(vna_avg_variance(avg) / avg->count) : 0.0;
+}
+
+// Whether a streaming average has reached the averaging target
+static bool vna_avg_done(const vna_avg_t *avg) {
+    return avg_target > 0.0 && avg->count >= VNA_AVG_MIN_COUNT && vna_avg_std_err(avg) <= avg_target;
+}
+
+// Hands the pending point its gamma
+static void vna_finish_point() {
+    *pending.dest = pending.avg.mean;
+    pending.dest = NULL;
+
+    if(pending.info) {
+        pending.info->variance = vna_avg_variance(&pending.avg);
+        pending.info->count = pending.avg.count;
+        pending.info->rejected = pending.avg.rejected;
+        pending.info = NULL;
     }
-    double_cplx_t mean = cplx_scale(sum, 1.0/num_avgs);
+}
+
+// DSP stage: computes the raw gamma of the pending capture, and the point's gamma once all of
+// its captures are in
+static void vna_run_dsp_stage(bool overlapped) {
+    if(!pending.raw_pending) return;
+    uint64_t t_start = time_us_64();
+
+    uint32_t rr_mask = pending.mode == VNA_CAPTURE_SIMULTANEOUS ? ADC_DUAL_RR_MASK : ADC_RR_MASK;
+    double_cplx_t gamma = vna_calc_gamma_raw_capture(raw_ref, raw_rfl, rr_mask);
+    if(pending.mode == VNA_CAPTURE_SWITCHED) {     // Undo rfl_turns
+        double_cplx_t derotate = {cos(2*MATH_PI*pending.rfl_turns), -sin(2*MATH_PI*pending.rfl_turns)};
+        gamma = cplx_mult(gamma, derotate);
+    }
+    if(!vna_avg_add(&pending.avg, gamma)) stage_times.outliers++;
+    pending.num_done++;
+    pending.raw_pending = false;
+
+    if(pending.num_done == pending.num_avgs) vna_finish_point();
+
+    uint64_t dsp_us = time_us_64() - t_start;
+    stage_times.dsp_us += dsp_us;
+    if(overlapped) stage_times.dsp_overlapped_us += dsp_us;
+}
+
+// Takes a point's captures, leaving the DSP of the last one for later
+void vna_meas_point_start(int num_avgs, double_cplx_t *gamma, vna_point_info_t *info) {
+    vna_run_dsp_stage(false);  // Finish the previous point if nothing has yet
 
-    if(num_avgs <= 2) return mean;
+    if(num_avgs < 1) num_avgs = 1;
+    if(num_avgs > VNA_MAX_AVGS) num_avgs = VNA_MAX_AVGS;
+    pending.dest = gamma;
+    pending.info = info;
+    pending.num_avgs = num_avgs;
+    pending.num_done = 0;
+    vna_avg_reset(&pending.avg);
 
-    // If enough points, drop one outlier
-    int outlier_index = 0;
-    double max_diff = 0;
     for(int i = 0; i < num_avgs; i++) {
-        double diff = cplx_mag(cplx_sub(points[i], mean));
-        if(diff > max_diff) {
-            outlier_index = i;
-            max_diff = diff;
+        if(avg_target > 0.0 && i >= VNA_AVG_MIN_COUNT) {
+            // Deciding whether to stop needs every capture so far, so this one's DSP can't overlap
+            vna_run_dsp_stage(false);
+            if(vna_avg_done(&pending.avg)) {
+                pending.num_avgs = pending.num_done;
+                vna_finish_point();
+                break;
+            }
         }
+        vna_capture_point_once();
+    }
+
+    // Settling is complete once the captures are in, while the next point would overwrite it
+    if(info) info->settle = last_settle;
+}
+
+// Sets the standard error at which points stop averaging
+void vna_set_avg_target(double max_std_err) {
+    avg_target = max_std_err;
+}
+
+// Finishes the DSP of any started point and stops the ADC stream
+void vna_meas_finish() {
+    adc_stream_stop();  // Done with the ADC until the next point
+    vna_run_dsp_stage(false);
+}
+
+// Time spent in each stage since vna_reset_stage_times
+vna_stage_times_t vna_get_stage_times() {
+    return stage_times;
+}
+
+void vna_reset_stage_times() {
+    stage_times = (vna_stage_times_t) {0};
+}
+
+// Selects how each point is captured
+void vna_set_capture_mode(vna_capture_mode_t mode) {
+    if(mode == VNA_CAPTURE_SIMULTANEOUS) rx_adc_init_dual();
+    capture_mode = mode;
+}
+
+// Selects whether the PIO restart starts the ADC stream of each point
+void vna_set_synced_adc_start(bool enabled) {
+    synced_adc_start = enabled;
+}
+
+// Settling times of the most recent point
+vna_settle_info_t vna_get_last_settle() {
+    return last_settle;
+}
+
+// Selects how vna_calc_gamma_raw estimates gamma from the captures
+void vna_set_gamma_estimator(vna_gamma_estimator_t estimator) {
+    gamma_estimator = estimator;
+}
+
+// Sums of the per-sample estimator: the mean of rfl/ref over each (I,Q) pair
+typedef struct {
+#if DSP_NUMERIC == DSP_Q15
+    int64_t a, b;       // Quotients in Q15
+#else
+    dsp_acc_t a, b;
+#endif
+} per_sample_sums_t;
+
+static inline void per_sample_add(per_sample_sums_t *sums, dsp_sample_t ref_a, dsp_sample_t ref_b,
+                                  dsp_sample_t rfl_a, dsp_sample_t rfl_b) {
+#if DSP_NUMERIC == DSP_Q15
+    // rfl/ref = rfl*conj(ref) / |ref|^2, with each quotient kept in Q15
+    int64_t mag2 = (int64_t)ref_a*ref_a + (int64_t)ref_b*ref_b;
+    if(mag2 == 0) return;  // No reference to divide by
+    int64_t num_a = ((int64_t)rfl_a*ref_a + (int64_t)rfl_b*ref_b) << 15;
+    int64_t num_b = ((int64_t)ref_a*rfl_b - (int64_t)rfl_a*ref_b) << 15;
+    // Round to nearest, so truncation doesn't bias the average
+    sums->a += (num_a + (num_a < 0 ? -mag2 : mag2) / 2) / mag2;
+    sums->b += (num_b + (num_b < 0 ? -mag2 : mag2) / 2) / mag2;
+#else
+    // cplx_div(rfl, ref), in the DSP type
+    dsp_acc_t mag2 = ref_a*ref_a + ref_b*ref_b;
+    sums->a += (rfl_a*ref_a + rfl_b*ref_b) / mag2;
+    sums->b += (ref_a*rfl_b - rfl_a*ref_b) / mag2;
+#endif
+}
+
+static double_cplx_t per_sample_result(const per_sample_sums_t *sums) {
+#if DSP_NUMERIC == DSP_Q15
+    const double scale = 1.0 / (32768.0 * NUM_SAMPLES_PROCESSED);
+    return (double_cplx_t) {sums->a * scale, sums->b * scale};
+#else
+    return (double_cplx_t) {(double)sums->a / NUM_SAMPLES_PROCESSED, (double)sums->b / NUM_SAMPLES_PROCESSED};
+#endif
+}
+
+// Sums of the cross-spectrum estimator: sum(rfl*conj(ref)) / sum(|ref|^2), a single division per
+// point, and samples where the reference is near zero carry proportionally little weight instead
+// of blowing up
+typedef struct {
+#if DSP_NUMERIC == DSP_Q15
+    int64_t cross_a, cross_b, power;
+#else
+    dsp_acc_t cross_a, cross_b, power;
+#endif
+} cross_spectrum_sums_t;
+
+static inline void cross_spectrum_add(cross_spectrum_sums_t *sums, dsp_sample_t ref_a, dsp_sample_t ref_b,
+                                      dsp_sample_t rfl_a, dsp_sample_t rfl_b) {
+#if DSP_NUMERIC == DSP_Q15
+    int32_t ra = ref_a, rb = ref_b, fa = rfl_a, fb = rfl_b;
+    sums->cross_a += (int64_t)fa*ra + (int64_t)fb*rb;
+    sums->cross_b += (int64_t)ra*fb - (int64_t)fa*rb;
+    sums->power += (int64_t)ra*ra + (int64_t)rb*rb;
+#else
+    sums->cross_a += rfl_a*ref_a + rfl_b*ref_b;
+    sums->cross_b += ref_a*rfl_b - rfl_a*ref_b;
+    sums->power += ref_a*ref_a + ref_b*ref_b;
+#endif
+}
+
+static double_cplx_t cross_spectrum_result(const cross_spectrum_sums_t *sums) {
+    if(sums->power == 0) return cplx_zero;  // No reference to divide by
+    double inv_power = 1.0 / (double)sums->power;
+    return (double_cplx_t) {sums->cross_a * inv_power, sums->cross_b * inv_power};
+}
+
+// Computes the uncal'd gamma from deinterleaved incident and reflected captures
+double_cplx_t vna_calc_gamma_raw(dsp_sample_t *ref_I, dsp_sample_t *ref_Q, dsp_sample_t *rfl_I, dsp_sample_t *rfl_Q) {
+    if(gamma_estimator == VNA_GAMMA_PER_SAMPLE) {
+        per_sample_sums_t sums = {0};
+        for(int i = NUM_SAMPLES - NUM_SAMPLES_PROCESSED; i < NUM_SAMPLES; i++) // For each (I,Q) pair
+            per_sample_add(&sums, ref_I[i], ref_Q[i], rfl_I[i], rfl_Q[i]);
+        return per_sample_result(&sums);
     }
 
-    // Compute mean with outlier thrown out
-    sum = cplx_sub(sum, points[outlier_index]);
-    mean = cplx_scale(sum, 1.0/(num_avgs - 1.0));
-    return mean;
+    cross_spectrum_sums_t sums = {0};
+    for(int i = NUM_SAMPLES - NUM_SAMPLES_PROCESSED; i < NUM_SAMPLES; i++) // For each (I,Q) pair
+        cross_spectrum_add(&sums, ref_I[i], ref_Q[i], rfl_I[i], rfl_Q[i]);
+    return cross_spectrum_result(&sums);
+}
+
+// As vna_calc_gamma_raw, reading the samples through views of the raw captures
+static double_cplx_t vna_calc_gamma_raw_view(const iq_view_t *ref_I, const iq_view_t *ref_Q,
+                                             const iq_view_t *rfl_I, const iq_view_t *rfl_Q) {
+    if(gamma_estimator == VNA_GAMMA_PER_SAMPLE) {
+        per_sample_sums_t sums = {0};
+        for(int i = NUM_SAMPLES - NUM_SAMPLES_PROCESSED; i < NUM_SAMPLES; i++) // For each (I,Q) pair
+            per_sample_add(&sums, iq_view_at(ref_I, i), iq_view_at(ref_Q, i), iq_view_at(rfl_I, i), iq_view_at(rfl_Q, i));
+        return per_sample_result(&sums);
+    }
+
+    cross_spectrum_sums_t sums = {0};
+    for(int i = NUM_SAMPLES - NUM_SAMPLES_PROCESSED; i < NUM_SAMPLES; i++) // For each (I,Q) pair
+        cross_spectrum_add(&sums, iq_view_at(ref_I, i), iq_view_at(ref_Q, i), iq_view_at(rfl_I, i), iq_view_at(rfl_Q, i));
+    return cross_spectrum_result(&sums);
+}
+
+// Computes the uncal'd gamma from raw captures, without copying them
+double_cplx_t vna_calc_gamma_raw_capture(const uint16_t *ref_samples, const uint16_t *rfl_samples, uint32_t rr_mask) {
+    if(gamma_estimator == VNA_GAMMA_DFT) {
+        double_cplx_t ref = calc_phasor_dft(ref_samples, rr_mask, 0);
+        double_cplx_t rfl = rr_mask == ADC_DUAL_RR_MASK ? calc_phasor_dft(ref_samples, rr_mask, 1)
+                                                        : calc_phasor_dft(rfl_samples, rr_mask, 0);
+        if(ref.a == 0.0 && ref.b == 0.0) return cplx_zero;  // No reference to divide by
+        return cplx_div(rfl, ref);
+    }
+
+    iq_view_t ref_I, ref_Q, rfl_I, rfl_Q;
+    if(rr_mask == ADC_DUAL_RR_MASK) {
+        dual_iq_views(ref_samples, &ref_I, &ref_Q, &rfl_I, &rfl_Q);
+    } else {
+        iq_views(ref_samples, &ref_I, &ref_Q);
+        iq_views(rfl_samples, &rfl_I, &rfl_Q);
+    }
+    return vna_calc_gamma_raw_view(&ref_I, &ref_Q, &rfl_I, &rfl_Q);
+}
+
+double_cplx_t vna_meas_point_gamma_raw(int num_avgs) {
+    double_cplx_t gamma;
+    vna_meas_point_start(num_avgs, &gamma, NULL);
+    vna_meas_finish();
+    return gamma;
+}
+
+// Gamma of a termination (gamma_t, against VNA_CAL_Z0) seen through an offset line, with the
+// line's loss making its impedance complex and its propagation lossy, as cal kit definitions model it
+static double_cplx_t vna_cal_offset_gamma(const vna_cal_offset_t *off, double_cplx_t gamma_t, double f_hz) {
+    if(off->delay_ps <= 0.0) return gamma_t;
+
+    double w = 2.0*MATH_PI*f_hz;
+    double delay = off->delay_ps * 1e-12;
+    double loss = off->loss * 1e9 * sqrt(f_hz / 1e9);  // ohms/s at f
+
+    // Line impedance, and the reflection at its input from the change in impedance
+    double_cplx_t zc = {off->z0 + loss/(2.0*w), -loss/(2.0*w)};
+    double_cplx_t g1 = cplx_div(cplx_sub(zc, ((double_cplx_t) {VNA_CAL_Z0, 0.0})),
+                                cplx_add(zc, ((double_cplx_t) {VNA_CAL_Z0, 0.0})));
+
+    // Round trip along the line: exp(-2*gamma*l), gamma*l = alpha*l + j(w*delay + alpha*l)
+    double al = loss*delay / (2.0*off->z0);
+    double bl = w*delay + al;
+    double_cplx_t rt = {exp(-2.0*al) * cos(-2.0*bl), exp(-2.0*al) * sin(-2.0*bl)};
+
+    // (g1*(1 - rt - g1*gamma_t) + rt*gamma_t) / (1 - g1*(rt*g1 + gamma_t*(1 - rt)))
+    double_cplx_t one_m_rt = cplx_sub(cplx_unity, rt);
+    double_cplx_t g1_gt = cplx_mult(g1, gamma_t);
+    double_cplx_t num = cplx_add(cplx_mult(g1, cplx_sub(one_m_rt, g1_gt)), cplx_mult(rt, gamma_t));
+    double_cplx_t den = cplx_sub(cplx_unity, cplx_mult(g1, cplx_add(cplx_mult(rt, g1), cplx_mult(gamma_t, one_m_rt))));
+    return cplx_div(num, den);
+}
+
+// Gamma against VNA_CAL_Z0 of an impedance x*j (a reactance)
+static double_cplx_t vna_cal_reactance_gamma(double x) {
+    return cplx_div(((double_cplx_t) {-VNA_CAL_Z0, x}), ((double_cplx_t) {VNA_CAL_Z0, x}));
+}
+
+// Actual Gammas of a cal kit's standards at a frequency in kHz
+vna_cal_standards_t vna_cal_kit_standards(const vna_cal_kit_t *kit, double freq) {
+    double f = freq * 1e3;
+    double w = 2.0*MATH_PI*f;
+
+    double l = (kit->l0*1e-12 + kit->l1*1e-24*f + kit->l2*1e-33*f*f + kit->l3*1e-42*f*f*f);
+    double c = (kit->c0*1e-15 + kit->c1*1e-27*f + kit->c2*1e-36*f*f + kit->c3*1e-45*f*f*f);
+    double_cplx_t gt_short = vna_cal_reactance_gamma(w*l);
+    // The open is Z = -j/(wC), so Gamma = (1 - jwCZ0)/(1 + jwCZ0), which is fine at C = 0
+    double wcz = w*c*VNA_CAL_Z0;
+    double_cplx_t gt_open = cplx_div(((double_cplx_t) {1.0, -wcz}), ((double_cplx_t) {1.0, wcz}));
+    double_cplx_t gt_load = {(kit->load_r - VNA_CAL_Z0) / (kit->load_r + VNA_CAL_Z0), 0.0};
+
+    return (vna_cal_standards_t) {
+        vna_cal_offset_gamma(&kit->short_offset, gt_short, f),
+        vna_cal_offset_gamma(&kit->open_offset, gt_open, f),
+        vna_cal_offset_gamma(&kit->load_offset, gt_load, f)
+    };
 }
 
 // Returns set of error terms given measurements of short, open, load.
@@ -143,22 +592,22 @@ double_cplx_t vna_meas_point_gamma_raw(int num_avgs) {
 // These equations find the error terms based on algebraic solutions via Cramer's rule to the
 // equations given here: http://emlab.uiuc.edu/ece451/appnotes/Rytting_NAModels.pdf
 // They are solved here, which is what is used below: https://k6jca.blogspot.com/search/label/VNA%3A%2012-term%20Error%20Model
-error_terms_t vna_cal_point(double_cplx_t m_short, double_cplx_t m_open, double_cplx_t m_load) {
+error_terms_t vna_cal_point(double_cplx_t m_short, double_cplx_t m_open, double_cplx_t m_load, vna_cal_standards_t stds) {
     // Common denominator
     double_cplx_t denom = cplx_add(
         cplx_add(
             cplx_sub(
                 cplx_sub(
-                    cplx_mult(cplx_mult(Gamma_Short, Gamma_Open), m_short),
-                    cplx_mult(cplx_mult(Gamma_Short, Gamma_Open), m_open)
+                    cplx_mult(cplx_mult(stds.g_short, stds.g_open), m_short),
+                    cplx_mult(cplx_mult(stds.g_short, stds.g_open), m_open)
                 ),
-                cplx_mult(cplx_mult(Gamma_Short, Gamma_Load), m_short)
+                cplx_mult(cplx_mult(stds.g_short, stds.g_load), m_short)
             ),
-            cplx_mult(cplx_mult(Gamma_Short, Gamma_Load), m_load)
+            cplx_mult(cplx_mult(stds.g_short, stds.g_load), m_load)
         ),
         cplx_sub(
-            cplx_mult(cplx_mult(Gamma_Open, Gamma_Load), m_open),
-            cplx_mult(cplx_mult(Gamma_Open, Gamma_Load), m_load)
+            cplx_mult(cplx_mult(stds.g_open, stds.g_load), m_open),
+            cplx_mult(cplx_mult(stds.g_open, stds.g_load), m_load)
         )
     );
 
@@ -167,17 +616,17 @@ error_terms_t vna_cal_point(double_cplx_t m_short, double_cplx_t m_open, double_
     double_cplx_t num_e00 = cplx_add(
         cplx_add(
             cplx_sub(
-                cplx_mult(cplx_mult(Gamma_Short, Gamma_Open), cplx_mult(m_short, m_load)),
-                cplx_mult(cplx_mult(Gamma_Short, Gamma_Load), cplx_mult(m_short, m_open))
+                cplx_mult(cplx_mult(stds.g_short, stds.g_open), cplx_mult(m_short, m_load)),
+                cplx_mult(cplx_mult(stds.g_short, stds.g_load), cplx_mult(m_short, m_open))
             ),
             cplx_sub(
-                cplx_mult(cplx_mult(Gamma_Open, Gamma_Load), cplx_mult(m_short, m_open)),
-                cplx_mult(cplx_mult(Gamma_Short, Gamma_Open), cplx_mult(m_open, m_load))
+                cplx_mult(cplx_mult(stds.g_open, stds.g_load), cplx_mult(m_short, m_open)),
+                cplx_mult(cplx_mult(stds.g_short, stds.g_open), cplx_mult(m_open, m_load))
             )
         ),
         cplx_sub(
-            cplx_mult(cplx_mult(Gamma_Short, Gamma_Load), cplx_mult(m_open, m_load)),
-            cplx_mult(cplx_mult(Gamma_Open, Gamma_Load), cplx_mult(m_short, m_load))
+            cplx_mult(cplx_mult(stds.g_short, stds.g_load), cplx_mult(m_open, m_load)),
+            cplx_mult(cplx_mult(stds.g_open, stds.g_load), cplx_mult(m_short, m_load))
         )
     );
 
@@ -188,17 +637,17 @@ error_terms_t vna_cal_point(double_cplx_t m_short, double_cplx_t m_open, double_
         cplx_add(
             cplx_add(
                 cplx_sub(
-                    cplx_mult(Gamma_Short, m_open),
-                    cplx_mult(Gamma_Open, m_short)
+                    cplx_mult(stds.g_short, m_open),
+                    cplx_mult(stds.g_open, m_short)
                 ),
                 cplx_sub(
-                    cplx_mult(Gamma_Load, m_short),
-                    cplx_mult(Gamma_Short, m_load)
+                    cplx_mult(stds.g_load, m_short),
+                    cplx_mult(stds.g_short, m_load)
                 )
             ),
             cplx_sub(
-                cplx_mult(Gamma_Open, m_load),
-                cplx_mult(Gamma_Load, m_open)
+                cplx_mult(stds.g_open, m_load),
+                cplx_mult(stds.g_load, m_open)
             )
         ), -1.0
     );
@@ -210,17 +659,17 @@ error_terms_t vna_cal_point(double_cplx_t m_short, double_cplx_t m_open, double_
         cplx_add(
             cplx_add(
                 cplx_sub(
-                    cplx_mult(Gamma_Short, cplx_mult(m_short, m_open)),
-                    cplx_mult(Gamma_Short, cplx_mult(m_short, m_load))
+                    cplx_mult(stds.g_short, cplx_mult(m_short, m_open)),
+                    cplx_mult(stds.g_short, cplx_mult(m_short, m_load))
                 ),
                 cplx_sub(
-                    cplx_mult(Gamma_Open, cplx_mult(m_open, m_load)),
-                    cplx_mult(Gamma_Open, cplx_mult(m_short, m_open))
+                    cplx_mult(stds.g_open, cplx_mult(m_open, m_load)),
+                    cplx_mult(stds.g_open, cplx_mult(m_short, m_open))
                 )
             ),
             cplx_sub(
-                cplx_mult(Gamma_Load, cplx_mult(m_short, m_load)),
-                cplx_mult(Gamma_Load, cplx_mult(m_open, m_load))
+                cplx_mult(stds.g_load, cplx_mult(m_short, m_load)),
+                cplx_mult(stds.g_load, cplx_mult(m_open, m_load))
             )
         ), -1.0
     );
@@ -231,6 +680,61 @@ error_terms_t vna_cal_point(double_cplx_t m_short, double_cplx_t m_open, double_
     return (error_terms_t){e00, e11, d_e};
 }
 
+// Coefficients of the cal solution that depend only on the standards
+vna_cal_coeffs_t vna_cal_coeffs(vna_cal_standards_t stds) {
+    double_cplx_t g_short = stds.g_short, g_open = stds.g_open, g_load = stds.g_load;
+    double_cplx_t so = cplx_mult(g_short, g_open);
+    double_cplx_t sl = cplx_mult(g_short, g_load);
+    double_cplx_t ol = cplx_mult(g_open, g_load);
+    return (vna_cal_coeffs_t) {
+        {cplx_sub(so, sl), cplx_sub(ol, so), cplx_sub(sl, ol)},                         // Denominator
+        {cplx_sub(ol, sl), cplx_sub(so, ol), cplx_sub(sl, so)},                         // e00
+        {cplx_sub(g_open, g_load), cplx_sub(g_load, g_short), cplx_sub(g_short, g_open)}, // e11
+        {cplx_sub(g_open, g_short), cplx_sub(g_short, g_load), cplx_sub(g_load, g_open)}  // Delta e
+    };
+}
+
+// c[0]*x + c[1]*y + c[2]*z
+static inline double_cplx_t vna_cal_combine(const double_cplx_t *c, double_cplx_t x, double_cplx_t y, double_cplx_t z) {
+    double_cplx_t cx = cplx_mult(c[0], x);
+    double_cplx_t cy = cplx_mult(c[1], y);
+    double_cplx_t cz = cplx_mult(c[2], z);
+    return (double_cplx_t) {cx.a + cy.a + cz.a, cx.b + cy.b + cz.b};
+}
+
+// Error terms of one point from coefficients, with one reciprocal of the denominator
+static inline error_terms_t vna_cal_solve(const vna_cal_coeffs_t *c, double_cplx_t ms, double_cplx_t mo, double_cplx_t ml) {
+    double_cplx_t m_so = cplx_mult(ms, mo);
+    double_cplx_t m_sl = cplx_mult(ms, ml);
+    double_cplx_t m_ol = cplx_mult(mo, ml);
+
+    double_cplx_t denom = vna_cal_combine(c->denom, ms, mo, ml);
+    double norm = 1.0 / (denom.a*denom.a + denom.b*denom.b);
+    double_cplx_t inv = {denom.a*norm, -denom.b*norm};
+
+    double_cplx_t num_e00 = vna_cal_combine(c->e00, m_so, m_sl, m_ol);
+    double_cplx_t num_e11 = vna_cal_combine(c->e11, ms, mo, ml);
+    double_cplx_t num_de = vna_cal_combine(c->de, m_so, m_sl, m_ol);
+    return (error_terms_t) {cplx_mult(num_e00, inv), cplx_mult(num_e11, inv), cplx_mult(num_de, inv)};
+}
+
+// Error terms of num_points points at once
+void vna_cal_points(const vna_cal_coeffs_t *coeffs, const double_cplx_t *m_short, const double_cplx_t *m_open,
+                    const double_cplx_t *m_load, error_terms_t *cal, int num_points) {
+    const vna_cal_coeffs_t c = *coeffs;     // A local copy, so stores to cal can't alias it
+    for(int i = 0; i < num_points; i++)
+        cal[i] = vna_cal_solve(&c, m_short[i], m_open[i], m_load[i]);
+}
+
+// Error terms of num_points points at once, with per-point standards
+void vna_cal_points_stds(const vna_cal_standards_t *stds, const double_cplx_t *m_short, const double_cplx_t *m_open,
+                         const double_cplx_t *m_load, error_terms_t *cal, int num_points) {
+    for(int i = 0; i < num_points; i++) {
+        vna_cal_coeffs_t c = vna_cal_coeffs(stds[i]);   // Products only, no divisions
+        cal[i] = vna_cal_solve(&c, m_short[i], m_open[i], m_load[i]);
+    }
+}
+
 // Returns calibrated Gamma from a raw Gamma and error terms
 double_cplx_t vna_apply_cal_point(double_cplx_t gamma, error_terms_t err_terms) {
     double_cplx_t num = cplx_sub(gamma, err_terms.e0);
@@ -238,4 +742,14 @@ double_cplx_t vna_apply_cal_point(double_cplx_t gamma, error_terms_t err_terms)
     return cplx_div(num, denom);
 }
 
+// Returns the variance of the calibrated Gamma from that of a raw Gamma.
+// dGamma_cald/dGamma = (e0*e1 - De) / (gamma*e1 - De)^2
+double vna_apply_cal_variance(double_cplx_t gamma, double variance, error_terms_t err_terms) {
+    double_cplx_t denom = cplx_sub(cplx_mult(gamma, err_terms.e1), err_terms.De);
+    double_cplx_t deriv = cplx_div(cplx_sub(cplx_mult(err_terms.e0, err_terms.e1), err_terms.De),
+                                   cplx_mult(denom, denom));
+    double gain = cplx_mag(deriv);
+    return gain*gain * variance;
+}
+
 
@@ -10,9 +10,18 @@
 
 // Config for taking a reading
 #define RDG_STEADYSTATE_DELAY_MS 2  // Number of ms to wait before assuming steady state and taking measurement
-#define RDG_FREQCHANGE_DELAY_MS 10  // Number of ms to wait before assuming steady state and taking measurement
 #define RDG_ADC_FREQ ADC_INPUT_FREQ  // Desired frequency to have at the ADC (kHz)
 
+// Settling detector: after a frequency change, phase reset or path switch, short ADC bursts are
+// taken until the level on each path changes by no more than RDG_SETTLE_TOLERANCE (relative to the
+// incident level, or RDG_SETTLE_MIN_COUNTS if that is smaller) from one burst to the next
+#define RDG_SETTLE_TOLERANCE 0.002
+#define RDG_SETTLE_MIN_COUNTS 200   // ADC counts; keeps burst-to-burst noise on weak signals from reading as movement
+#define RDG_SETTLE_TIMEOUT_US 50000 // Give up waiting and measure anyway
+
+// Timeout for the reflected path settling after its switch in switched captures
+#define RDG_SWITCH_SETTLE_US 50000
+
 // Pin to reset the accumulator in the DDS source for phase alignment
 #define SRC_RESET 16
 
@@ -22,6 +31,38 @@
 #define Gamma_Load (double_cplx_t) {0.0, 0.0}  // Using an ideal 50-Ohm load
 // #define Gamma_Load (double_cplx_t) {1.0/101.0, 0.0}  // Using a 51-Ohm resistor
 
+// Actual Gamma values of the cal standards at one frequency
+typedef struct {
+    double_cplx_t g_short;
+    double_cplx_t g_open;
+    double_cplx_t g_load;
+} vna_cal_standards_t;
+
+#define VNA_CAL_STANDARDS_IDEAL (vna_cal_standards_t) {Gamma_Short, Gamma_Open, Gamma_Load}
+
+// Reference impedance of the cal kit models, ohms
+#define VNA_CAL_Z0 50.0
+
+// Transmission line between a cal standard's reference plane and its termination, as given in
+// cal kit definitions
+typedef struct {
+    double delay_ps;    // One-way offset delay
+    double loss;        // Offset loss, ohms/ns at 1GHz (scaling with sqrt(f))
+    double z0;          // Offset impedance, ohms
+} vna_cal_offset_t;
+
+// Characterized cal standards: each an offset line into its termination.
+// The open's fringing capacitance is C0 + C1*f + C2*f^2 + C3*f^3 and the short's inductance
+// L0 + L1*f + L2*f^2 + L3*f^3, f in Hz, in the usual cal kit units.
+typedef struct {
+    vna_cal_offset_t short_offset;
+    double l0, l1, l2, l3;          // pH, 1e-24 H/Hz, 1e-33 H/Hz^2, 1e-42 H/Hz^3
+    vna_cal_offset_t open_offset;
+    double c0, c1, c2, c3;          // fF, 1e-27 F/Hz, 1e-36 F/Hz^2, 1e-45 F/Hz^3
+    vna_cal_offset_t load_offset;
+    double load_r;                  // ohms
+} vna_cal_kit_t;
+
 // Error terms for one port
 typedef struct {
     double_cplx_t e0;   // e00
@@ -29,6 +70,84 @@ typedef struct {
     double_cplx_t De;   // e00*e11 - e10*e01
 } error_terms_t;
 
+// Ways of estimating the raw gamma from incident and reflected captures
+typedef enum {
+    VNA_GAMMA_PER_SAMPLE,       // Mean of rfl/ref over each (I,Q) pair
+    VNA_GAMMA_CROSS_SPECTRUM,   // sum(rfl*conj(ref)) / sum(|ref|^2), one division per point
+    VNA_GAMMA_DFT               // Ratio of the phasors from calc_phasor_dft on the raw captures,
+                                // which cancels I/Q sampling skew and needs no deinterleaving (default)
+} vna_gamma_estimator_t;
+
+// Ways of capturing the incident and reflected signals for each point
+typedef enum {
+    VNA_CAPTURE_SWITCHED,       // One path at a time through the receiver's switches, settling after each
+    VNA_CAPTURE_SIMULTANEOUS    // Both paths in one capture of all four ADC inputs (needs a detector per path,
+                                // the second on ADC_RFL_I/ADC_RFL_Q, which a stock Pico doesn't have free)
+} vna_capture_mode_t;
+
+// Settling of the most recent point, as found by the settling detector
+typedef struct {
+    uint32_t freq_us;   // After the frequency change
+    uint32_t path_us;   // After phase reset and path switching, summed over the point's captures
+                        // (for switched reflected captures, until settled rather than the fixed wait)
+    uint32_t timeouts;  // Waits that hit RDG_SETTLE_TIMEOUT_US
+} vna_settle_info_t;
+
+// Noise and settling of one measured point, to judge how far to trust it
+typedef struct {
+    double variance;            // Sample variance of the point's raw gammas, E|gamma - mean|^2 (0 for one)
+    uint16_t count;             // Captures in its mean
+    uint16_t rejected;          // Captures rejected as outliers
+    vna_settle_info_t settle;
+} vna_point_info_t;
+
+// Most captures averaged into one point
+#define VNA_MAX_AVGS 32
+
+// Streaming average of a point's raw gammas (vna_avg_add): Welford's running mean and variance of
+// the complex values, so no captures are kept. Once VNA_AVG_REJECT_MIN_COUNT are in, a gamma further
+// than VNA_AVG_OUTLIER_SIGMAS standard deviations from the running mean is rejected as an outlier.
+// The variance is never taken below VNA_AVG_MIN_VARIANCE, so a few captures that happen to agree
+// don't make every later one an outlier, or report a point as noiseless.
+#define VNA_AVG_MIN_COUNT 3
+#define VNA_AVG_REJECT_MIN_COUNT 5
+#define VNA_AVG_OUTLIER_SIGMAS 3.0
+// |Γ|^2: ADC quantization noise (1/12 LSB^2 per conversion) in the phasors of a NUM_SAMPLES capture
+// of each path, with an incident level of RDG_SETTLE_MIN_COUNTS
+#define VNA_AVG_MIN_VARIANCE (2 * 4.0 / 12 / NUM_SAMPLES / ((double) RDG_SETTLE_MIN_COUNTS * RDG_SETTLE_MIN_COUNTS))
+
+typedef struct {
+    int count;              // Gammas in the mean
+    int rejected;           // Gammas dropped as outliers
+    double_cplx_t mean;
+    double m2;              // Sum of |gamma - mean|^2 over the gammas in the mean
+} vna_avg_t;
+
+// Time spent in each stage of measuring points, since vna_reset_stage_times
+typedef struct {
+    uint64_t retune_us;         // Writing LO and source frequencies, and restarting their phase
+    uint64_t settle_us;         // Waiting for the receiver to settle, less any DSP done meanwhile
+    uint64_t capture_us;        // Reading captures from the ADC stream
+    uint64_t dsp_us;            // Deinterleaving, raw gamma and averaging
+    uint64_t dsp_overlapped_us; // Part of dsp_us done while waiting for the receiver to settle
+    uint32_t captures;          // Captures taken
+    uint32_t outliers;          // Of which rejected by the averaging
+} vna_stage_times_t;
+
+// LO divider limits, in 1/256 PIO clocks
+#define VNA_LO_DIV8_MIN (1 << 8)
+#define VNA_LO_DIV8_MAX ((0xFFFF << 8) | 0xFF)
+
+// Register settings for one frequency point, from vna_plan_freq
+typedef struct {
+    uint32_t lo_div_int;    // LO clock divider, whole PIO clocks
+    uint8_t lo_div_frac8;   // and 1/256ths
+    uint16_t src_lsw;       // AD9834 tuning word, as the halves written to its frequency register
+    uint16_t src_msw;
+    double lo_freq;         // Resulting LO (as rx_setfreq) and source frequencies, kHz
+    double src_freq;
+} vna_freq_plan_t;
+
 // Complex number math specific to VNA measurements
 #define gamma_to_s11dB(gamma) 20*log10(cplx_mag(gamma))
 #define gamma_to_VSWR(gamma) ((double)cplx_mag(gamma) + 1.0)/(1.0 - (double)cplx_mag(gamma))
@@ -46,20 +165,127 @@ double vna_refl_levelcheck(double freq);
 
 
 /*************** SINGLE-POINT VNA MEASUREMENTS ***************/
-// Sets LO as close as possible to a given frequency in kHz
-// and sets the source appropriately to result in a proper ADC_FREQ.
+// Plans the settings for a source frequency in kHz: the LO divider (in 1/256 steps) nearest to
+// freq - RDG_ADC_FREQ, then the source tuning word nearest to that LO + RDG_ADC_FREQ, so the IF
+// is RDG_ADC_FREQ to within the AD9834's resolution and the source lands within half an LO step
+// of freq
+vna_freq_plan_t vna_plan_freq(double freq);
+
+// Writes the settings from vna_plan_freq and waits for the receiver to settle.
+// Returns the actual source frequency.
+double vna_set_freq_plan(const vna_freq_plan_t *plan);
+
+// Stages a planned point while the current one is measured: its source tuning word goes into the
+// AD9834's idle frequency register (by DMA, in the background) without changing the output.
+// vna_commit_freq then retunes with one LO divider write and one AD9834 control write, and waits
+// for the receiver to settle. Setting a frequency any other way in between discards the staged
+// point, and vna_commit_freq falls back to writing it in full. Returns the actual source frequency,
+// or -1 (leaving the frequency as it was) if no point has been staged since the last commit.
+void vna_stage_freq_plan(const vna_freq_plan_t *plan);
+double vna_commit_freq();
+
+// Plans and sets a source frequency in kHz, as vna_plan_freq and vna_set_freq_plan.
 // Returns the actual source frequency.
-double vna_set_freq(uint16_t freq);
+double vna_set_freq(double freq);
 
-// Takes a measurement and returns the uncal'd gamma value
+// Takes a measurement and returns the uncal'd gamma value (up to VNA_MAX_AVGS captures averaged)
 // Does not touch current frequency settings
 double_cplx_t vna_meas_point_gamma_raw(int num_avgs);
 
-// Returns set of error terms given measurements of short, open, load.
+// Empties a streaming average
+void vna_avg_reset(vna_avg_t *avg);
+
+// Adds a gamma to a streaming average; returns false if it was rejected as an outlier
+bool vna_avg_add(vna_avg_t *avg, double_cplx_t gamma);
+
+// Sample variance (E|gamma - mean|^2, at least VNA_AVG_MIN_VARIANCE) and standard error of the
+// mean (the expected |ΔΓ| of the average) of a streaming average, or 0 with fewer than two gammas
+double vna_avg_variance(const vna_avg_t *avg);
+double vna_avg_std_err(const vna_avg_t *avg);
+
+// Averaging target for points: with num_avgs > 1, a point stops taking captures once at least
+// VNA_AVG_MIN_COUNT are in and the standard error of their mean is at most max_std_err, so
+// num_avgs becomes an upper bound. 0 (the default) always takes all num_avgs captures.
+void vna_set_avg_target(double max_std_err);
+
+// Measures the uncal'd gamma of a point into *gamma, in two stages: the captures are taken before
+// this returns, but the DSP of the last one is left until the receiver is next waiting to settle
+// (e.g. in the next vna_set_freq) or vna_meas_finish is called, so that it overlaps with retuning.
+// The DSP of each other capture overlaps with the settling of the one after it, except while an
+// averaging target (vna_set_avg_target) needs each result before deciding on the next capture.
+// If info isn't NULL, the point's noise and settling go there, at the same time as its gamma.
+void vna_meas_point_start(int num_avgs, double_cplx_t *gamma, vna_point_info_t *info);
+
+// Finishes the DSP of any point started by vna_meas_point_start and stops the ADC stream
+void vna_meas_finish();
+
+// Time spent in each stage since vna_reset_stage_times
+vna_stage_times_t vna_get_stage_times();
+void vna_reset_stage_times();
+
+// Selects the estimator used for raw gamma (VNA_GAMMA_DFT by default).
+// The per-sample estimator's error from I/Q sampling skew depends on the IF phase at the start of
+// the capture. That is only repeatable, and so removed by calibration, with a synced ADC start
+// (see vna_set_synced_adc_start).
+void vna_set_gamma_estimator(vna_gamma_estimator_t estimator);
+
+// Selects how each point is captured (VNA_CAPTURE_SWITCHED by default). Selecting
+// VNA_CAPTURE_SIMULTANEOUS sets up the second detector's pins (rx_adc_init_dual).
+void vna_set_capture_mode(vna_capture_mode_t mode);
+
+// Selects whether the ADC stream of each point is started by the PIO as it restarts the source and
+// LO (the default), or by the CPU afterwards. Synced, every block starts at the same IF phase
+// however long a point takes to settle, since blocks are whole IF periods.
+void vna_set_synced_adc_start(bool enabled);
+
+// Settling times of the most recent point (since the last vna_set_freq)
+vna_settle_info_t vna_get_last_settle();
+
+// Computes the uncal'd gamma from deinterleaved incident and reflected captures
+// (as taken by take_interleaved_iq_samples). VNA_GAMMA_DFT needs the raw captures
+// (vna_calc_gamma_raw_capture), so deinterleaved ones fall back to the cross-spectrum.
+double_cplx_t vna_calc_gamma_raw(dsp_sample_t *ref_I, dsp_sample_t *ref_Q, dsp_sample_t *rfl_I, dsp_sample_t *rfl_Q);
+
+// Computes the uncal'd gamma from raw captures with the selected estimator: for ADC_RR_MASK,
+// separate incident and reflected captures of NUM_SAMPLES conversions; for ADC_DUAL_RR_MASK, one
+// capture of NUM_DUAL_SAMPLES conversions in ref_samples (rfl_samples unused)
+double_cplx_t vna_calc_gamma_raw_capture(const uint16_t *ref_samples, const uint16_t *rfl_samples, uint32_t rr_mask);
+
+// Actual Gammas of a cal kit's standards at a frequency in kHz
+vna_cal_standards_t vna_cal_kit_standards(const vna_cal_kit_t *kit, double freq);
+
+// Returns set of error terms given measurements of short, open, load, whose actual Gammas at this
+// point are stds (VNA_CAL_STANDARDS_IDEAL, or from vna_cal_kit_standards).
 // These error terms are valid only at this same freq point.
-error_terms_t vna_cal_point(double_cplx_t m_short, double_cplx_t m_open, double_cplx_t m_load);
+error_terms_t vna_cal_point(double_cplx_t m_short, double_cplx_t m_open, double_cplx_t m_load, vna_cal_standards_t stds);
+
+// Coefficients of the cal solution that depend only on the standards' actual Gammas, from
+// vna_cal_coeffs. The denominator and the e11 numerator are c[0]*m_short + c[1]*m_open + c[2]*m_load;
+// the e00 and Delta e numerators are c[0]*m_short*m_open + c[1]*m_short*m_load + c[2]*m_open*m_load.
+typedef struct {
+    double_cplx_t denom[3];
+    double_cplx_t e00[3];
+    double_cplx_t e11[3];
+    double_cplx_t de[3];
+} vna_cal_coeffs_t;
+
+vna_cal_coeffs_t vna_cal_coeffs(vna_cal_standards_t stds);
+
+// Error terms of num_points points from their measurements of short, open, load, as vna_cal_point
+// gives for each, but with the standards' products hoisted into coeffs and one reciprocal of the
+// denominator per point instead of three divisions
+void vna_cal_points(const vna_cal_coeffs_t *coeffs, const double_cplx_t *m_short, const double_cplx_t *m_open,
+                    const double_cplx_t *m_load, error_terms_t *cal, int num_points);
+
+// As vna_cal_points, but with the standards' actual Gammas given per point, in stds
+void vna_cal_points_stds(const vna_cal_standards_t *stds, const double_cplx_t *m_short, const double_cplx_t *m_open,
+                         const double_cplx_t *m_load, error_terms_t *cal, int num_points);
 
 // Returns calibrated Gamma from a raw Gamma and error terms
 double_cplx_t vna_apply_cal_point(double_cplx_t gamma, error_terms_t err_terms);
 
+// Returns the variance of the calibrated Gamma from that of a raw Gamma, to first order: the raw
+// variance times |dGamma_cald/dGamma|^2 at gamma
+double vna_apply_cal_variance(double_cplx_t gamma, double variance, error_terms_t err_terms);
+
 #endif
@@ -0,0 +1,188 @@
+// Benchmarks for the per-point DSP and calibration kernels
+
+#include "vnabench.h"
+#include <stdio.h>
+#include <math.h>
+#include "adc_sampling.h"
+#include "complex_math.h"
+
+// Fixed incident/reflected captures, as take_interleaved_iq_samples would see them
+static uint16_t ref_buf[NUM_SAMPLES];
+static uint16_t rfl_buf[NUM_SAMPLES];
+
+// Fixed four-way capture, as take_dual_iq_samples would see it
+static uint16_t dual_buf[NUM_DUAL_SAMPLES];
+
+// Filtered samples from convolve_valid
+static double fir_out[NUM_SAMPLES];
+
+static dsp_sample_t ref_I[NUM_SAMPLES];
+static dsp_sample_t ref_Q[NUM_SAMPLES];
+static dsp_sample_t rfl_I[NUM_SAMPLES];
+static dsp_sample_t rfl_Q[NUM_SAMPLES];
+
+// Raw cal standard measurements and error terms for the cal kernels
+static const double_cplx_t m_short = {-0.412, 0.215};
+static const double_cplx_t m_open = {0.498, -0.147};
+static const double_cplx_t m_load = {0.081, 0.023};
+static error_terms_t err_terms;
+static vna_cal_coeffs_t cal_coeffs;
+static error_terms_t batch_terms;
+
+// Keeps kernel results alive
+static volatile double sink;
+
+// Synthesizes a round-robin I/Q capture of a tone at the IF, with a little deterministic dither
+static void gen_capture(uint16_t *buf, double amplitude, double phase) {
+    uint32_t lcg = 12345;
+    for(int i = 0; i < NUM_SAMPLES; i++) {
+        double theta = 2.0*MATH_PI*ADC_INPUT_FREQ*i/ADC_TOTAL_SAMPLE_RATE + phase;
+        double v = (i % 2 == 0) ? cos(theta) : sin(theta);
+        lcg = lcg * 1664525 + 1013904223;
+        buf[i] = (uint16_t) lround(2048.0 + amplitude*v + (double)(lcg >> 30) - 1.5);
+    }
+}
+
+static double bench_deinterleave() {
+    deinterleave_iq_samples(ref_buf, ref_I, ref_Q);
+    return DSP_COUNTS(ref_I[NUM_SAMPLES-1]);
+}
+
+static double bench_deinterleave_dual() {
+    deinterleave_dual_iq_samples(dual_buf, ref_I, ref_Q, rfl_I, rfl_Q);
+    return DSP_COUNTS(rfl_Q[NUM_SAMPLES-1]);
+}
+
+static double bench_calc_phasor() {
+    return calc_phasor(ref_I, ref_Q).a;
+}
+
+static double bench_gamma_raw() {
+    vna_set_gamma_estimator(VNA_GAMMA_PER_SAMPLE);
+    return vna_calc_gamma_raw(ref_I, ref_Q, rfl_I, rfl_Q).a;
+}
+
+static double bench_gamma_raw_xspec() {
+    vna_set_gamma_estimator(VNA_GAMMA_CROSS_SPECTRUM);
+    return vna_calc_gamma_raw(ref_I, ref_Q, rfl_I, rfl_Q).a;
+}
+
+// Cross-spectrum read through views of the raw captures, including what deinterleaving did
+static double bench_gamma_raw_xspec_view() {
+    vna_set_gamma_estimator(VNA_GAMMA_CROSS_SPECTRUM);
+    return vna_calc_gamma_raw_capture(ref_buf, rfl_buf, ADC_RR_MASK).a;
+}
+
+static double bench_phasor_dft() {
+    return calc_phasor_dft(ref_buf, ADC_RR_MASK, 0).a;
+}
+
+// Everything the sweep pipeline's DSP stage does for a switched capture with the default
+// estimator, i.e. the time per point that pipelining takes off the sweep
+static double bench_point_dsp() {
+    vna_set_gamma_estimator(VNA_GAMMA_DFT);
+    return vna_calc_gamma_raw_capture(ref_buf, rfl_buf, ADC_RR_MASK).a;
+}
+
+static double bench_gen_fir_h() {
+    gen_fir_h(FIR_IF_CENTER, FIR_IF_WIDTH);
+    return 0.0;
+}
+
+// Cycles through one more center than the cache holds, so every call generates a kernel
+static double bench_gen_fir_h_uncached() {
+    static int next = 0;
+    gen_fir_h(FIR_IF_CENTER * (2 + next), FIR_IF_WIDTH);
+    next = (next + 1) % (FIR_CACHE_SIZE + 1);
+    return 0.0;
+}
+
+static double bench_convolve() {
+    convolve(ref_buf);
+    return 0.0;
+}
+
+static double bench_convolve_valid() {
+    return convolve_valid(ref_buf, 1, fir_out);
+}
+
+static double bench_convolve_valid_decimated() {
+    return convolve_valid(ref_buf, FIR_IF_DECIMATION, fir_out);
+}
+
+static double bench_goertzel() {
+    return goertzel_rms(ref_buf, NUM_SAMPLES, ((double) ADC_INPUT_FREQ) / ADC_TOTAL_SAMPLE_RATE);
+}
+
+static double bench_cal_point() {
+    return vna_cal_point(m_short, m_open, m_load, VNA_CAL_STANDARDS_IDEAL).e0.a;
+}
+
+// One point of the batched kernel; the coefficients are hoisted out of the sweep, so not timed
+static double bench_cal_points() {
+    vna_cal_points(&cal_coeffs, &m_short, &m_open, &m_load, &batch_terms, 1);
+    return batch_terms.e0.a;
+}
+
+static double bench_apply_cal_point() {
+    return vna_apply_cal_point(m_load, err_terms).a;
+}
+
+static const struct {
+    const char *name;
+    double (*run)();
+} kernels[] = {
+    {"deinterleave_iq_samples", bench_deinterleave},
+    {"deinterleave_dual_iq_samples", bench_deinterleave_dual},
+    {"calc_phasor", bench_calc_phasor},
+    {"calc_phasor_dft", bench_phasor_dft},
+    {"vna_calc_gamma_raw", bench_gamma_raw},
+    {"vna_calc_gamma_raw_xspec", bench_gamma_raw_xspec},
+    {"vna_calc_gamma_raw_xspec_view", bench_gamma_raw_xspec_view},
+    {"point_dsp_stage", bench_point_dsp},
+    {"gen_fir_h", bench_gen_fir_h},
+    {"gen_fir_h_uncached", bench_gen_fir_h_uncached},
+    {"convolve", bench_convolve},
+    {"convolve_valid", bench_convolve_valid},
+    {"convolve_valid_decimated", bench_convolve_valid_decimated},
+    {"goertzel_rms", bench_goertzel},
+    {"vna_cal_point", bench_cal_point},
+    {"vna_cal_points", bench_cal_points},
+    {"vna_apply_cal_point", bench_apply_cal_point},
+};
+
+void vna_bench_run(const char *platform, const vna_bench_timer_t *timer, uint32_t iterations) {
+    // Set up inputs for every kernel
+    gen_capture(ref_buf, 900.0, 0.3);
+    gen_capture(rfl_buf, 360.0, 0.3 + MATH_PI/3);
+    for(int i = 0; i < NUM_SAMPLES; i++) {
+        dual_buf[2*i - (i % 2)] = ref_buf[i];       // Slot 4j + c for I/Q sample c of pair j
+        dual_buf[2*i - (i % 2) + 2] = rfl_buf[i];
+    }
+    deinterleave_iq_samples(ref_buf, ref_I, ref_Q);
+    deinterleave_iq_samples(rfl_buf, rfl_I, rfl_Q);
+    err_terms = vna_cal_point(m_short, m_open, m_load, VNA_CAL_STANDARDS_IDEAL);
+    cal_coeffs = vna_cal_coeffs(VNA_CAL_STANDARDS_IDEAL);
+
+    printf("platform,dsp,kernel,iterations,ns_per_point,cycles_per_point\n");
+    for(size_t k = 0; k < sizeof(kernels)/sizeof(kernels[0]); k++) {
+        bench_gen_fir_h();  // convolve uses the kernel at the IF
+        kernels[k].run();  // Warm up
+
+        uint64_t c0 = timer->cycles ? timer->cycles() : 0;
+        uint64_t t0 = timer->time_ns();
+        for(uint32_t i = 0; i < iterations; i++) {
+            sink = kernels[k].run();
+        }
+        uint64_t t1 = timer->time_ns();
+        uint64_t c1 = timer->cycles ? timer->cycles() : 0;
+
+        double ns = (double)(t1 - t0) / iterations;
+        printf("%s,%s,%s,%lu,%.1f,", platform, DSP_NUMERIC_NAME, kernels[k].name, (unsigned long) iterations, ns);
+        if(timer->cycles) printf("%.1f\n", (double)(c1 - c0) / iterations);
+        else if(timer->cpu_hz > 0) printf("%.1f\n", ns * timer->cpu_hz / 1e9);
+        else printf("\n");
+    }
+
+    vna_set_gamma_estimator(VNA_GAMMA_DFT);  // Back to the default
+}
@@ -0,0 +1,23 @@
+// Benchmarks for the per-point DSP and calibration kernels, run over fixed capture buffers
+// so results are comparable between builds and between host and target.
+
+#ifndef VNA_BENCH_H
+#define VNA_BENCH_H
+
+#include <stdint.h>
+#include "vna.h"
+
+// Clock source for the benchmarks
+typedef struct {
+    uint64_t (*time_ns)();  // Monotonic time in ns
+    uint64_t (*cycles)();   // Cycle counter, or NULL to derive cycles from time and cpu_hz
+    double cpu_hz;          // Core clock (Hz) for deriving cycles, or 0 if unknown
+} vna_bench_timer_t;
+
+// Runs every kernel `iterations` times and prints one CSV line per kernel:
+//   platform,dsp,kernel,iterations,ns_per_point,cycles_per_point
+// where dsp is the DSP_NUMERIC type the firmware was built with.
+// Each kernel call corresponds to one frequency point. cycles_per_point is empty if unknown.
+void vna_bench_run(const char *platform, const vna_bench_timer_t *timer, uint32_t iterations);
+
+#endif
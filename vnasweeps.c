@@ -1,76 +1,217 @@
 #include "vnasweeps.h"
 #include "complex_math.h"
+#include <stdio.h>
+#include <math.h>
+#include <pico/stdlib.h>
 
-// Creates a new, initialized vna_meas_t instance based on a given setup
-// Dynamic allocation is used, so vna_meas_deinit must follow if multiple are
-// initialized in order to avoid a memory leak.
-vna_meas_t vna_meas_init(vna_meas_setup_t *setup) {
-    int numpts = setup->num_points;
-    vna_meas_t meas = {
-        setup,  // Setup
-        malloc(numpts * sizeof(double)),  // Freq points
+// Whether sweeps print the settling time of each point
+static bool settle_report = false;
+
+// Whether the DSP of each point overlaps with retuning to the next
+static bool pipelined = true;
+
+// Timing of the most recent sweep
+static vna_sweep_stats_t last_stats;
+
+// Number of points a setup sweeps
+uint vna_sweep_num_points(const vna_meas_setup_t *setup) {
+    if(setup->mode != VNA_SWEEP_SEGMENTED) return setup->num_points;
+
+    uint numpts = 0;
+    for (uint s = 0; s < setup->num_segments; s++)
+        numpts += setup->segments[s].num_points;
+    return numpts;
+}
+
+// Whether a setup describes a sweep that can be planned: log spacing needs positive frequencies
+bool vna_sweep_setup_valid(const vna_meas_setup_t *setup) {
+    switch(setup->mode) {
+        case VNA_SWEEP_LINEAR:
+            return true;
+        case VNA_SWEEP_LOG:
+            return setup->start_freq > 0 && setup->end_freq > 0;
+        case VNA_SWEEP_SEGMENTED:
+            if(!setup->segments) return setup->num_segments == 0;
+            for (uint s = 0; s < setup->num_segments; s++) {
+                const vna_sweep_segment_t *seg = &setup->segments[s];
+                if(seg->log && !(seg->start_freq > 0 && seg->end_freq > 0)) return false;
+            }
+            return true;
+        case VNA_SWEEP_LIST:
+            return setup->freq_list || setup->num_points == 0;
+    }
+    return false;
+}
+
+// Frequency of point i of num_points spaced from start_freq towards end_freq
+static double vna_sweep_point_freq(double start_freq, double end_freq, uint num_points, bool log_spaced, uint i) {
+    if(log_spaced) return start_freq * pow(end_freq / start_freq, (double) i / num_points);
+    return start_freq + (end_freq - start_freq) / num_points * i;
+}
+
+// Plans the register settings for every point of a setup into points
+static void vna_sweep_plan_fill(const vna_meas_setup_t *setup, vna_freq_plan_t *points) {
+    uint numpts = vna_sweep_num_points(setup);
+    uint i = 0;
+    switch(setup->mode) {
+        case VNA_SWEEP_LINEAR:
+        case VNA_SWEEP_LOG:
+            for (; i < numpts; i++) {
+                double freq = vna_sweep_point_freq(setup->start_freq, setup->end_freq, numpts,
+                                                   setup->mode == VNA_SWEEP_LOG, i);
+                points[i] = vna_plan_freq(freq);
+            }
+            break;
+        case VNA_SWEEP_SEGMENTED:
+            for (uint s = 0; s < setup->num_segments; s++) {
+                const vna_sweep_segment_t *seg = &setup->segments[s];
+                for (uint j = 0; j < seg->num_points; j++, i++)
+                    points[i] = vna_plan_freq(vna_sweep_point_freq(seg->start_freq, seg->end_freq,
+                                                                  seg->num_points, seg->log, j));
+            }
+            break;
+        case VNA_SWEEP_LIST:
+            for (; i < numpts; i++)
+                points[i] = vna_plan_freq(setup->freq_list[i]);
+            break;
+    }
+}
+
+// Every per-point type carved from an arena is a whole number of doubles, so consecutive arrays
+// stay aligned (and VNA_MEAS_POINT_BYTES needs no padding)
+#define VNA_MEAS_ASSERT_ALIGNED(type) \
+    _Static_assert(sizeof(type) % sizeof(double) == 0, #type " would misalign the arrays carved after it")
+VNA_MEAS_ASSERT_ALIGNED(vna_freq_plan_t);
+VNA_MEAS_ASSERT_ALIGNED(double_cplx_t);
+VNA_MEAS_ASSERT_ALIGNED(vna_cal_standards_t);
+VNA_MEAS_ASSERT_ALIGNED(error_terms_t);
+VNA_MEAS_ASSERT_ALIGNED(vna_point_info_t);
+
+// Hands out the next bytes of an arena
+static void *vna_meas_carve(uint8_t **next, size_t bytes) {
+    void *p = *next;
+    *next += bytes;
+    return p;
+}
+
+// Creates a new, initialized vna_meas_t instance based on a given setup, in storage
+vna_meas_t vna_meas_init_in(vna_meas_setup_t *setup, void *storage, size_t bytes) {
+    uint numpts = vna_sweep_num_points(setup);
+    vna_meas_t meas = {0};
+    meas.setup = setup;
+    if(!vna_sweep_setup_valid(setup) || !storage || bytes < numpts * VNA_MEAS_POINT_BYTES)
+        return meas;    // Empty: no points to sweep
+    meas.arena = storage;
 
-        malloc(numpts * sizeof(double_cplx_t)),  // cal_short
-        malloc(numpts * sizeof(double_cplx_t)),  // cal_open
-        malloc(numpts * sizeof(double_cplx_t)),  // cal_load
+    // In the order that sweeps, vna_run_cal and vna_run_correction walk them
+    uint8_t *next = meas.arena;
+    meas.plan.num_points = numpts;
+    meas.plan.points = vna_meas_carve(&next, numpts * sizeof(vna_freq_plan_t));
+    meas.frequencies = vna_meas_carve(&next, numpts * sizeof(double));
+    meas.cal_short = vna_meas_carve(&next, numpts * sizeof(double_cplx_t));
+    meas.cal_open = vna_meas_carve(&next, numpts * sizeof(double_cplx_t));
+    meas.cal_load = vna_meas_carve(&next, numpts * sizeof(double_cplx_t));
+    meas.standards = vna_meas_carve(&next, numpts * sizeof(vna_cal_standards_t));
+    meas.cal = vna_meas_carve(&next, numpts * sizeof(error_terms_t));
+    meas.gammas_uncald = vna_meas_carve(&next, numpts * sizeof(double_cplx_t));
+    meas.point_info = vna_meas_carve(&next, numpts * sizeof(vna_point_info_t));
+    meas.gammas_cald = vna_meas_carve(&next, numpts * sizeof(double_cplx_t));
+    meas.point_info_cald = vna_meas_carve(&next, numpts * sizeof(vna_point_info_t));
 
-        malloc(numpts * sizeof(error_terms_t)),  // cal
+    vna_sweep_plan_fill(setup, meas.plan.points);
 
-        malloc(numpts * sizeof(double_cplx_t)),  // gammas_uncald
-        malloc(numpts * sizeof(double_cplx_t))   // gammas_cald
-    };
+    // Actual frequencies are known from the plan before the first sweep, and so are the
+    // standards' Gammas at them
+    for (uint i = 0; i < numpts; i++) {
+        meas.frequencies[i] = meas.plan.points[i].src_freq;
+        meas.standards[i] = setup->cal_kit ? vna_cal_kit_standards(setup->cal_kit, meas.frequencies[i])
+                                           : VNA_CAL_STANDARDS_IDEAL;
+    }
+    return meas;
+}
+
+// Creates a new, initialized vna_meas_t instance based on a given setup
+// All of its arrays share one allocation, so vna_meas_deinit must follow if multiple are
+// initialized in order to avoid a memory leak.
+vna_meas_t vna_meas_init(vna_meas_setup_t *setup) {
+    size_t bytes = vna_sweep_num_points(setup) * VNA_MEAS_POINT_BYTES;
+    void *arena = malloc(bytes);
+    vna_meas_t meas = vna_meas_init_in(setup, arena, bytes);
+    if(!meas.arena) free(arena);    // Rejected setup
+    meas.owns_arena = meas.arena != NULL;
     return meas;
 }
 
-// Frees memory from a previously initialized instance
-void vna_meas_deinit(vna_meas_t meas) {
-    free(meas.frequencies);
-    free(meas.cal_short);
-    free(meas.cal_open);
-    free(meas.cal_load);
-    free(meas.cal);
-    free(meas.gammas_uncald);
-    free(meas.gammas_cald);
-
-    // Good practice to set things to null after freeing
-    meas.setup = NULL;
-    meas.frequencies = NULL;
-    meas.cal_short = NULL;
-    meas.cal_open = NULL;
-    meas.cal_load = NULL;
-    meas.cal = NULL;
-    meas.gammas_uncald = NULL;
-    meas.gammas_cald = NULL;
+// Frees memory from a previously initialized instance, leaving it empty
+void vna_meas_deinit(vna_meas_t *meas) {
+    if(meas->owns_arena) free(meas->arena);
+    *meas = (vna_meas_t) {0};
 }
 
 // Stores an array of frequency points and an array of uncal'd Gamma values based on a measurement setup
-void vna_sweep_freq(vna_meas_t meas, double_cplx_t* gammas, uint8_t numavgs) {  // Assumes meas is already initialized!
-    vna_meas_setup_t meas_setup = *meas.setup;
-    double stepsize = (meas_setup.end_freq - meas_setup.start_freq) / meas_setup.num_points;
-    // const double approx_pts_per_decade = (double)meas_setup.num_points / log10(meas_setup.end_freq / meas_setup.start_freq);
-    // double log_step_size = log10(meas_setup.end_freq / meas_setup.start_freq) * (approx_pts_per_decade - 1);
-    uint i = 0;
-    // Store frequency and gamma for each point
-    for (int i = 0; i < meas_setup.num_points; i++) {  // For each freq point
-        // double freq = pow(10, log10(meas_setup.start_freq) + i * log_step_size);
-        double freq = meas_setup.start_freq + stepsize*i;
-        meas.frequencies[i] = vna_set_freq(freq);
-        if(i>0 && meas.frequencies[i-1] == freq) {
-            gammas[i] = gammas[i-1];
-            continue;  // Don't remeasure for duplicate points
+void vna_sweep_freq(vna_meas_t meas, double_cplx_t* gammas, vna_point_info_t *info, uint8_t numavgs) {  // Assumes meas is already initialized!
+    vna_sweep_plan_t plan = meas.plan;
+    uint64_t t_start = time_us_64();
+    vna_reset_stage_times();
+
+    // Store frequency and gamma for each point. Each point's source setting is staged while the
+    // one before it is measured, so retuning is a single register switch.
+    if(plan.num_points > 0) vna_stage_freq_plan(&plan.points[0]);
+    for (uint i = 0; i < plan.num_points; i++) {  // For each freq point
+        meas.frequencies[i] = vna_commit_freq();  // Also finishes the DSP of the previous point
+        if(i + 1 < plan.num_points) vna_stage_freq_plan(&plan.points[i + 1]);
+        vna_meas_point_start(numavgs, &gammas[i], info ? &info[i] : NULL);
+        if(!pipelined) vna_meas_finish();
+
+        if(settle_report) {
+            vna_settle_info_t settle = vna_get_last_settle();
+            printf("#Settle %.1f kHz: %lu us after freq change, %lu us after path switching%s\n\r",
+                meas.frequencies[i], (unsigned long) settle.freq_us, (unsigned long) settle.path_us,
+                settle.timeouts ? " (timed out)" : "");
         }
-        gammas[i] = vna_meas_point_gamma_raw(numavgs);
     }
+    vna_meas_finish();
+
+    last_stats.points = plan.num_points;
+    last_stats.total_us = time_us_64() - t_start;
+    last_stats.stages = vna_get_stage_times();
+}
+
+// Selects whether the DSP of each point overlaps with retuning to the next (the default)
+void vna_sweep_set_pipelined(bool enable) {
+    pipelined = enable;
+}
+
+// Timing of the most recent sweep
+vna_sweep_stats_t vna_sweep_get_stats() {
+    return last_stats;
+}
+
+// Enables printing the settling time of each point during sweeps
+void vna_sweep_set_settle_report(bool enable) {
+    settle_report = enable;
 }
 
 // Calculates error terms based on raw cal data
 void vna_run_cal(vna_meas_t calmeas) {
-    for (int i = 0; i < calmeas.setup->num_points; i++)  // Run cal function on each frequency point
-        calmeas.cal[i] = vna_cal_point(calmeas.cal_short[i], calmeas.cal_open[i], calmeas.cal_load[i]);
+    if(calmeas.setup->cal_kit) {
+        vna_cal_points_stds(calmeas.standards, calmeas.cal_short, calmeas.cal_open, calmeas.cal_load,
+                            calmeas.cal, calmeas.plan.num_points);
+        return;
+    }
+
+    // Ideal standards are the same at every point
+    vna_cal_coeffs_t coeffs = vna_cal_coeffs(VNA_CAL_STANDARDS_IDEAL);
+    vna_cal_points(&coeffs, calmeas.cal_short, calmeas.cal_open, calmeas.cal_load, calmeas.cal,
+                   calmeas.plan.num_points);
 }
 
 // Calculates actual Gamma values based on error terms
 void vna_run_correction(vna_meas_t calmeas) {
-    for (int i = 0; i < calmeas.setup->num_points; i++)  // Run cal application function on each frequency point
+    for (uint i = 0; i < calmeas.plan.num_points; i++) {  // Run cal application function on each frequency point
         calmeas.gammas_cald[i] = vna_apply_cal_point(calmeas.gammas_uncald[i], calmeas.cal[i]);
+        calmeas.point_info_cald[i] = calmeas.point_info[i];
+        calmeas.point_info_cald[i].variance = vna_apply_cal_variance(calmeas.gammas_uncald[i],
+                                                                     calmeas.point_info[i].variance, calmeas.cal[i]);
+    }
 }
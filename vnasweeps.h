@@ -8,45 +8,133 @@
 #include <stdlib.h>
 #include "complex_math.h"
 
+// How the points of a sweep are spaced
+typedef enum {
+    VNA_SWEEP_LINEAR,       // Evenly spaced from start_freq, stepping (end_freq - start_freq)/num_points (default)
+    VNA_SWEEP_LOG,          // Evenly spaced in log(freq), with the same steps as linear in log terms
+    VNA_SWEEP_SEGMENTED,    // Consecutive linear or log segments, from segments
+    VNA_SWEEP_LIST          // The num_points frequencies in freq_list
+} vna_sweep_mode_t;
+
+// One segment of a VNA_SWEEP_SEGMENTED sweep, spaced as a whole linear or log sweep would be
+typedef struct {
+    double start_freq;  // kHz
+    double end_freq;    // kHz, excluded, so it can be the start of the next segment
+    uint num_points;
+    bool log;
+} vna_sweep_segment_t;
+
 // Describes the measurement setup
 typedef struct {
     // Start and end frequencies in kHz
     double start_freq;
     double end_freq;
-    // Number of points to store
-    double num_points;
+    // Number of points to store (for VNA_SWEEP_SEGMENTED, the sum over the segments is used)
+    uint num_points;
+
+    // Spacing of the points; start_freq/end_freq only apply to linear and log sweeps
+    vna_sweep_mode_t mode;
+    const vna_sweep_segment_t *segments;    // For VNA_SWEEP_SEGMENTED, num_segments of them
+    uint num_segments;
+    const double *freq_list;                // For VNA_SWEEP_LIST, in kHz
+
+    // Model of the cal standards, evaluated at every point once by vna_meas_init;
+    // NULL for ideal ones (Gamma_Short, Gamma_Open and Gamma_Load)
+    const vna_cal_kit_t *cal_kit;
 } vna_meas_setup_t;
 
+// Register settings for every point of a sweep, planned once from a vna_meas_setup_t so that
+// each sweep only replays them
+typedef struct {
+    uint num_points;
+    vna_freq_plan_t *points;    // LO divider, source tuning word and actual frequencies of each point
+} vna_sweep_plan_t;
+
 // Stores a full VNA measurement
 typedef struct {
     // Data setup
     vna_meas_setup_t *setup;         // Measurement setup used
     double *frequencies;            // Array of (actual) frequencies swept
+    vna_sweep_plan_t plan;          // Register settings for each point, planned by vna_meas_init
 
     // Raw calibration data
     double_cplx_t *cal_short, *cal_open, *cal_load;
+    // Actual Gammas of the cal standards at each point, from setup->cal_kit
+    vna_cal_standards_t *standards;
     // Cal data
     error_terms_t *cal;
 
     // Actual measurement data
     double_cplx_t *gammas_uncald;   // Array of un-calibrated Gamma values
     double_cplx_t *gammas_cald;     // Array of calibrated Gamma values
+
+    // Noise and settling of each point of the measurement sweep (passed to vna_sweep_freq with gammas_uncald)
+    vna_point_info_t *point_info;
+    // The same for the calibrated Gamma values, with their variance propagated through the error terms
+    vna_point_info_t *point_info_cald;
+
+    void *arena;                    // The one block holding every array above (and plan.points)
+    bool owns_arena;                // Allocated by vna_meas_init, rather than storage passed to vna_meas_init_in
 } vna_meas_t;
 
-// Creates a new, initialized vna_meas_t instance based on a given setup
-// Dynamic allocation is used, so vna_meas_deinit must follow if multiple are
-// initialized in order to avoid a memory leak.
+// Bytes of vna_meas_t arrays per point
+#define VNA_MEAS_POINT_BYTES (sizeof(vna_freq_plan_t) + sizeof(double) + 3*sizeof(double_cplx_t) + \
+                              sizeof(vna_cal_standards_t) + sizeof(error_terms_t) + 2*sizeof(double_cplx_t) + \
+                              2*sizeof(vna_point_info_t))
+
+// Declares static storage for a measurement of up to num_points points, sized at compile time,
+// for vna_meas_init_in(setup, name, sizeof(name)). Made of doubles so that it is aligned like a
+// heap block, and it shows up as name in the linker map.
+#define VNA_MEAS_STATIC_STORAGE(name, num_points) \
+    static double name[((num_points) * VNA_MEAS_POINT_BYTES + sizeof(double) - 1) / sizeof(double)]
+
+// Timing of a sweep
+typedef struct {
+    uint32_t points;
+    uint64_t total_us;
+    vna_stage_times_t stages;   // Where the time went (see vna_stage_times_t)
+} vna_sweep_stats_t;
+
+// Number of points a setup sweeps
+uint vna_sweep_num_points(const vna_meas_setup_t *setup);
+// Whether a setup can be swept: log spacing (of the whole sweep or a segment) needs start_freq and
+// end_freq above 0, and segmented and list sweeps need their arrays
+bool vna_sweep_setup_valid(const vna_meas_setup_t *setup);
+
+// Creates a new, initialized vna_meas_t instance based on a given setup, including its sweep
+// plan, so changes to the setup afterwards need a new instance.
+// Its arrays are carved from one allocation of VNA_MEAS_POINT_BYTES per point, so vna_meas_deinit
+// must follow if multiple are initialized in order to avoid a memory leak. If that allocation fails,
+// or the setup is not valid (see vna_sweep_setup_valid), the instance is empty: arena is NULL and
+// there are no points.
 vna_meas_t vna_meas_init(vna_meas_setup_t *setup);
-// Frees memory from a previously initialized instance
-void vna_meas_deinit(vna_meas_t meas);
+// Creates a new, initialized vna_meas_t instance as vna_meas_init, but carves its arrays from the
+// bytes at storage (e.g. from VNA_MEAS_STATIC_STORAGE) instead of the heap. The instance is empty
+// if the setup needs more than that, or is not valid.
+vna_meas_t vna_meas_init_in(vna_meas_setup_t *setup, void *storage, size_t bytes);
+// Frees memory from a previously initialized instance (unless it came from vna_meas_init_in) and empties it
+void vna_meas_deinit(vna_meas_t *meas);
+
+// Stores an array of frequency points and an array of uncal'd Gamma values based on a measurement setup,
+// replaying the register settings in meas.plan. The noise and settling of each point go in info, unless
+// it is NULL: meas.point_info for the measurement sweep, so that vna_run_correction can use it.
+void vna_sweep_freq(vna_meas_t meas, double_cplx_t* gammas, vna_point_info_t *info, uint8_t numavgs);
+
+// Enables printing the settling time of each point during sweeps ("#Settle" lines), to find the
+// bands that settle slowest
+void vna_sweep_set_settle_report(bool enable);
+
+// Selects whether the DSP of each point overlaps with retuning to and settling at the next
+// (pipelined, the default), or finishes before the sweep moves on
+void vna_sweep_set_pipelined(bool enable);
 
-// Stores an array of frequency points and an array of uncal'd Gamma values based on a measurement setup
-void vna_sweep_freq(vna_meas_t meas, double_cplx_t* gammas, uint8_t numavgs);
+// Timing of the most recent sweep, broken down by stage
+vna_sweep_stats_t vna_sweep_get_stats();
 
-// Calculates error terms based on raw cal data
+// Calculates error terms based on raw cal data and the standards' actual Gammas
 void vna_run_cal(vna_meas_t calmeas);
 
-// Calculates actual Gamma values based on error terms
+// Calculates actual Gamma values based on error terms, and their point_info_cald from point_info
 void vna_run_correction(vna_meas_t calmeas);
 
 #endif